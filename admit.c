@@ -0,0 +1,109 @@
+/*
+ * admit.c - bounded 대기열 + (AIMD) 동시 처리 한도
+ */
+#include "csapp.h"
+#include "admit.h"
+#include "stats.h"
+#include "hist.h"
+#include "log.h"
+
+#define AIMD_INTERVAL_NS 50000000LL /* limit은 이 간격에 한 번만 바꾼다 */
+
+static conn_t *queue; /* 원형 대기열 */
+static int queue_max, front, count;
+static int active;           /* worker가 처리 중인 연결 수 */
+static int limit, max_limit; /* 동시 처리 한도와 그 상한(worker 수) */
+static long long target_ns, last_adjust;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ready = PTHREAD_COND_INITIALIZER; /* 꺼낼 연결이 있고 limit에 여유가 생김 */
+
+static void set_limit(int n)
+{
+  stats_add(STAT_ADMIT_LIMIT, n - limit);
+  limit = n;
+}
+
+/* mutex를 잡은 상태에서 호출. delay는 방금 꺼낸 연결이 대기열에서 기다린 시간 */
+static void aimd(long long delay)
+{
+  long long now;
+
+  if (target_ns == 0)
+    return;
+  now = hist_now();
+  if (now - last_adjust < AIMD_INTERVAL_NS)
+    return;
+  if (delay > target_ns && limit > 1)
+  {
+    set_limit(limit * 3 / 4 > 0 ? limit * 3 / 4 : 1);
+    LOGF(LOG_DEBUG, "admit: queue delay %ld us, limit down to %ld", NULL, (long)(delay / 1000), limit);
+  }
+  else if (delay <= target_ns && active >= limit && limit < max_limit)
+    set_limit(limit + 1);
+  else
+    return;
+  last_adjust = now;
+}
+
+void admit_init(int workers, int qmax, int target_ms)
+{
+  queue = Calloc(qmax, sizeof(conn_t));
+  queue_max = qmax;
+  front = count = active = 0;
+  max_limit = workers;
+  set_limit(workers);
+  target_ns = (long long)target_ms * 1000000LL;
+  last_adjust = 0;
+}
+
+int admit_offer(conn_t *conn)
+{
+  pthread_mutex_lock(&mutex);
+  if (count == queue_max)
+  {
+    pthread_mutex_unlock(&mutex);
+    stats_inc(STAT_SHED);
+    return 0;
+  }
+  queue[(front + count++) % queue_max] = *conn;
+  pthread_cond_signal(&ready);
+  pthread_mutex_unlock(&mutex);
+  stats_inc(STAT_QUEUED);
+  return 1;
+}
+
+void admit_take(conn_t *conn)
+{
+  pthread_mutex_lock(&mutex);
+  while (count == 0 || active >= limit)
+    pthread_cond_wait(&ready, &mutex);
+  *conn = queue[front];
+  front = (front + 1) % queue_max;
+  count--;
+  active++;
+  aimd(hist_now() - conn->accepted);
+  /* limit이 늘었으면 다른 worker도 꺼낼 수 있다 */
+  if (count > 0 && active < limit)
+    pthread_cond_signal(&ready);
+  pthread_mutex_unlock(&mutex);
+  stats_add(STAT_QUEUED, -1);
+}
+
+void admit_done(void)
+{
+  pthread_mutex_lock(&mutex);
+  active--;
+  if (count > 0 && active < limit)
+    pthread_cond_signal(&ready);
+  pthread_mutex_unlock(&mutex);
+}
+
+int admit_pending(void)
+{
+  int n;
+
+  pthread_mutex_lock(&mutex);
+  n = count + active;
+  pthread_mutex_unlock(&mutex);
+  return n;
+}
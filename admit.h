@@ -0,0 +1,41 @@
+/*
+ * admit.h - accept 루프의 admission control
+ *
+ * main은 accept한 연결을 크기가 정해진 대기열에 넣고, 미리 만들어 둔 worker 쓰레드들이
+ * 꺼내 처리한다 (echo_prethreading의 sbuf와 같은 구조). 동시에 처리하는 요청 수는 limit을,
+ * 대기열은 queue_max를 넘지 않는다. 대기열까지 차면 admit_offer()가 실패하고 main은 그 연결에
+ * 바로 503 + Retry-After로 답한다. 과부하에서도 받아들인 요청은 제 속도로 끝나므로
+ * 처리량이 무너지지 않는다.
+ *
+ * target_ms를 주면 limit을 대기열 지연에 맞춰 AIMD로 조절한다: 꺼낸 연결이 target보다 오래
+ * 기다렸으면 limit을 3/4로 줄이고, limit이 꽉 찬 상태에서 빨리 꺼냈으면 1 늘린다.
+ */
+#ifndef __ADMIT_H__
+#define __ADMIT_H__
+
+#include "csapp.h"
+
+#define DEFAULT_WORKERS 32    /* worker 쓰레드 수 = limit의 상한 */
+#define DEFAULT_QUEUE_MAX 256 /* 처리를 기다릴 수 있는 연결 수 */
+
+/* main이 accept한 연결을 worker에게 넘길 때 쓰는 항목 */
+typedef struct
+{
+  int connfd;
+  long long accepted; /* accept()가 끝난 시각 (hist_now) */
+} conn_t;
+
+/* target_ms가 0이면 limit은 workers로 고정 */
+void admit_init(int workers, int queue_max, int target_ms);
+
+/* 대기열에 넣으면 1, 가득 차 있으면 0 (호출한 쪽이 거절 응답을 보낸다) */
+int admit_offer(conn_t *conn);
+
+/* worker: 처리할 차례가 된 연결을 꺼낸다. 끝나면 반드시 admit_done() */
+void admit_take(conn_t *conn);
+void admit_done(void);
+
+/* 대기열에 있거나 worker가 처리 중인 연결 수 (drain.h) */
+int admit_pending(void);
+
+#endif /* __ADMIT_H__ */
@@ -0,0 +1,94 @@
+/*
+ * arena.c - 요청 하나 동안 쓰는 bump allocator
+ */
+#include "csapp.h"
+#include "arena.h"
+
+#define ARENA_ALIGN 16
+
+static arena_block_t *block_new(size_t cap)
+{
+  arena_block_t *b = Malloc(sizeof(arena_block_t) + cap);
+
+  b->next = NULL;
+  b->cap = cap;
+  return b;
+}
+
+void arena_init(arena_t *a, size_t size)
+{
+  a->head = a->cur = block_new(size);
+  a->used = 0;
+  a->last = NULL;
+}
+
+void arena_reset(arena_t *a)
+{
+  arena_block_t *b, *next;
+
+  for (b = a->head->next; b != NULL; b = next)
+  {
+    next = b->next;
+    Free(b);
+  }
+  a->head->next = NULL;
+  a->cur = a->head;
+  a->used = 0;
+  a->last = NULL;
+}
+
+void arena_destroy(arena_t *a)
+{
+  arena_reset(a);
+  Free(a->head);
+  a->head = a->cur = NULL;
+}
+
+void *arena_alloc(arena_t *a, size_t n)
+{
+  size_t off = (a->used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+  if (off + n > a->cur->cap)
+  {
+    /* 남은 자리는 버린다. 요청이 끝나면 어차피 모두 비운다 */
+    a->cur->next = block_new(n > ARENA_BLOCK ? n : ARENA_BLOCK);
+    a->cur = a->cur->next;
+    off = 0;
+  }
+  a->used = off + n;
+  a->last = a->cur->data + off;
+  return a->last;
+}
+
+void arena_trim(arena_t *a, void *p, size_t n)
+{
+  if (p == a->last)
+    a->used = (char *)p - a->cur->data + n;
+}
+
+char *arena_strdup(arena_t *a, const char *s)
+{
+  size_t n = strlen(s) + 1;
+
+  return memcpy(arena_alloc(a, n), s, n);
+}
+
+char *arena_readline(arena_t *a, rio_t *rp)
+{
+  char *line, *nl;
+  size_t max = MAXLINE;
+  ssize_t n;
+
+  /* 줄 끝이 이미 rio 버퍼에 들어와 있으면 그 길이만큼만 잡는다 */
+  if (rp->rio_cnt > 0 && (nl = memchr(rp->rio_bufptr, '\n', rp->rio_cnt)) != NULL &&
+      nl - rp->rio_bufptr + 2 < MAXLINE)
+    max = nl - rp->rio_bufptr + 2;
+  line = arena_alloc(a, max);
+  if ((n = rio_readlineb(rp, line, max)) <= 0)
+  {
+    arena_trim(a, line, 0);
+    return NULL;
+  }
+  arena_trim(a, line, n + 1);
+  return line;
+}
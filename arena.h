@@ -0,0 +1,48 @@
+/*
+ * arena.h - 요청 하나 동안 쓰는 bump allocator
+ *
+ * 요청 줄, header, 파싱한 문자열을 MAXLINE짜리 stack 배열 대신 실제 길이만큼 arena에서 잡는다.
+ * 개별 해제는 없고 요청이 끝나면 arena_reset()으로 한 번에 비운다. 첫 block은 reset해도
+ * 남겨 두므로, worker마다 arena 하나를 계속 쓰면 보통의 요청은 malloc 없이 처리된다.
+ * 쓰레드 하나만 쓴다 (lock 없음).
+ */
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include "csapp.h"
+
+/* 첫 block 크기: rio_t(8K) + 한 줄을 읽을 자리(MAXLINE) + 보통 요청의 header */
+#define ARENA_BLOCK (RIO_BUFSIZE + MAXLINE + 4096)
+
+typedef struct arena_block
+{
+  struct arena_block *next;
+  size_t cap;
+  char data[];
+} arena_block_t;
+
+typedef struct
+{
+  arena_block_t *head; /* 첫 block. reset해도 남긴다 */
+  arena_block_t *cur;  /* 지금 잘라 쓰는 block */
+  size_t used;         /* cur에서 쓴 바이트 */
+  char *last;          /* 마지막 할당 (arena_trim용) */
+} arena_t;
+
+void arena_init(arena_t *a, size_t size);
+void arena_reset(arena_t *a);
+void arena_destroy(arena_t *a);
+
+/* n 바이트 (16바이트 정렬). 모자라면 새 block을 붙인다 */
+void *arena_alloc(arena_t *a, size_t n);
+
+/* 마지막으로 할당한 p를 n 바이트로 줄인다. 0이면 통째로 돌려준다 */
+void arena_trim(arena_t *a, void *p, size_t n);
+
+char *arena_strdup(arena_t *a, const char *s);
+
+/* rp에서 한 줄(최대 MAXLINE-1 바이트)을 읽어 그 길이만큼만 arena에 담는다.
+   EOF나 읽기 실패(SO_RCVTIMEO가 지나 EAGAIN인 경우 포함)면 NULL. 실패면 errno가 남는다 */
+char *arena_readline(arena_t *a, rio_t *rp);
+
+#endif /* __ARENA_H__ */
@@ -0,0 +1,31 @@
+/*
+ * budget.c - 전역 버퍼 메모리 예산
+ */
+#include "csapp.h"
+#include "budget.h"
+#include "stats.h"
+#include "config.h"
+
+static size_t used;
+
+int budget_reserve(size_t n)
+{
+  size_t cur = __atomic_load_n(&used, __ATOMIC_RELAXED), limit = config_get()->mem_budget;
+
+  do
+  {
+    if (cur + n > limit)
+    {
+      stats_inc(STAT_BUDGET_DENIED);
+      return 0;
+    }
+  } while (!__atomic_compare_exchange_n(&used, &cur, cur + n, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  stats_add(STAT_BUFFERED_BYTES, n);
+  return 1;
+}
+
+void budget_release(size_t n)
+{
+  __atomic_fetch_sub(&used, n, __ATOMIC_RELAXED);
+  stats_add(STAT_BUFFERED_BYTES, -(long)n);
+}
@@ -0,0 +1,22 @@
+/*
+ * budget.h - 전체 proxy의 중계/캐시 버퍼 메모리 예산
+ *
+ * 연결마다 잡는 사용자 공간 버퍼(io_uring 중계 버퍼, 캐시 채움 버퍼)는 할당 전에
+ * budget_reserve()로 전역 예산을 먼저 확보한다. 예산이 모자라면 기다리지 않고 실패하며,
+ * 호출한 쪽은 더 작은 경로(rio 중계, 캐시 포기)로 물러난다.
+ * 그래서 느린 client가 아무리 많이 붙어도 버퍼 메모리 합은 예산을 넘지 않는다.
+ * 예산은 설정(config.h)의 mem_budget이다. 줄이면 이미 확보한 버퍼는 그대로 두고 새 확보만 막는다.
+ */
+#ifndef __BUDGET_H__
+#define __BUDGET_H__
+
+#include "csapp.h"
+
+#define DEFAULT_MEM_BUDGET (64 * 1024 * 1024) /* 전역 예산 */
+#define DEFAULT_CONN_BUDGET (64 * 1024)       /* 연결 하나가 end server에서 읽어 쥐고 있을 수 있는 양 */
+
+/* n 바이트를 확보하면 1, 예산을 넘으면 0 */
+int budget_reserve(size_t n);
+void budget_release(size_t n);
+
+#endif /* __BUDGET_H__ */
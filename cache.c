@@ -0,0 +1,800 @@
+/*
+ * cache.c - proxy의 웹 객체 캐시 (LRU, refcount)
+ */
+#include "csapp.h"
+#include "cache.h"
+#include "stats.h"
+#include "budget.h"
+#include "prefetch.h"
+#include "cachekey.h"
+#include "tinylfu.h"
+#include "slab.h"
+#include "negcache.h"
+#include "config.h"
+#include "shm.h"
+#include "log.h"
+#include <limits.h>
+
+#define CACHE_FILL_INIT 16384 /* 캐시 채움 버퍼의 첫 크기 */
+#define VARY_NAMES 256        /* Vary header 이름들을 이은 문자열의 상한 */
+/* 가장 큰 객체 slot([cache_obj_t][key\0][data])이 걸치는 page 수 */
+#define RUN_MAX ((int)((sizeof(cache_obj_t) + MAXLINE + MAX_OBJECT_SIZE) / SLAB_PAGE + 1))
+
+/* Vary 응답을 받은 URL. 변형마다 cache_obj_t가 따로 있고 이것을 가리킨다.
+   slab slot 하나에 [vary_t][key\0][names\0]로 담는다 */
+typedef struct vary
+{
+  char *key;          /* URL key */
+  uint64_t hash;
+  char *names;        /* 소문자 header 이름들, ','로 구분 */
+  int variants;       /* 리스트에 있는 변형 수 */
+  struct vary *hnext;
+} vary_t;
+
+/* 캐시 전체. 공유 메모리(shm.h)에 있어 모든 worker process가 같은 것을 본다 */
+typedef struct
+{
+  pthread_mutex_t mutex;       /* 아래 전부와 객체 refcnt, vary, slab, tinylfu sketch를 보호 (process 공유, robust) */
+  cache_obj_t *head, *tail;    /* LRU 리스트 */
+  cache_obj_t *buckets[CACHE_BUCKETS];
+  vary_t *vary_buckets[CACHE_BUCKETS];
+  size_t bytes;                /* 리스트에 있는 객체들의 data 크기 합 */
+  size_t prefetched;           /* 그중 prefetched인 객체들의 크기 합 */
+  int recovering;              /* 죽은 worker가 남긴 캐시를 비우려고, 빌려간 것이 다 돌아오기를 기다리는 중 */
+  long borrowed[CACHE_PROCS];  /* process마다 빌려간 객체와 아직 리스트에 넣지 않은 slot 수 */
+} cache_state_t;
+
+static cache_state_t *cs;
+static int me; /* 이 process의 번호 (cache_attach) */
+
+void cache_init(void)
+{
+  pthread_mutexattr_t attr;
+  size_t room = shm_room();
+
+  cs = shm_alloc(sizeof(cache_state_t));
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+  pthread_mutex_init(&cs->mutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+  slab_init(room < CACHE_SIZE_LIMIT ? room : CACHE_SIZE_LIMIT);
+  tinylfu_init();
+}
+
+void cache_attach(int proc)
+{
+  me = proc;
+}
+
+/* 빌려간 것이 모두 돌아왔으면 리스트, slab, sketch를 통째로 비우고 recovering을 끝낸다.
+   mutex를 잡은 상태에서 호출 */
+static void flush_if_idle(void)
+{
+  long n = 0;
+  int i;
+
+  for (i = 0; i < CACHE_PROCS; i++)
+    n += cs->borrowed[i];
+  if (n > 0)
+    return;
+  stats_clear(STAT_BYTES_CACHED);
+  cs->head = cs->tail = NULL;
+  memset(cs->buckets, 0, sizeof(cs->buckets));
+  memset(cs->vary_buckets, 0, sizeof(cs->vary_buckets));
+  cs->bytes = 0;
+  if (cs->prefetched)
+    prefetch_settle(cs->prefetched, 0);
+  cs->prefetched = 0;
+  slab_reset();
+  tinylfu_reset();
+  cs->recovering = 0;
+  LOGF(LOG_WARN, "cache: flushed after a worker died", NULL);
+}
+
+static void lock(void)
+{
+  int rc;
+
+  if ((rc = pthread_mutex_lock(&cs->mutex)) == EOWNERDEAD)
+  {
+    /* lock을 쥔 채 죽은 process가 있다. 리스트를 고치던 중이었을 수 있으므로 믿지 않고 비운다 */
+    pthread_mutex_consistent(&cs->mutex);
+    cs->recovering = 1;
+    flush_if_idle();
+  }
+  else if (rc != 0)
+    posix_error(rc, "cache lock error");
+}
+
+static void unlock(void)
+{
+  pthread_mutex_unlock(&cs->mutex);
+}
+
+void cache_reap(int proc)
+{
+  lock();
+  /* 죽은 process가 빌려간 객체의 refcnt는 영영 내려가지 않는다 */
+  if (cs->borrowed[proc] > 0)
+  {
+    cs->borrowed[proc] = 0;
+    cs->recovering = 1;
+  }
+  if (cs->recovering)
+    flush_if_idle();
+  unlock();
+}
+
+/* mutex를 잡은 상태에서 호출 */
+static void obj_free(cache_obj_t *obj)
+{
+  slab_free(obj);
+}
+
+/* mutex를 잡은 상태에서 호출 */
+static void list_unlink(cache_obj_t *obj)
+{
+  if (obj->prev)
+    obj->prev->next = obj->next;
+  else
+    cs->head = obj->next;
+  if (obj->next)
+    obj->next->prev = obj->prev;
+  else
+    cs->tail = obj->prev;
+  obj->prev = obj->next = NULL;
+}
+
+/* mutex를 잡은 상태에서 호출 */
+static void list_push_front(cache_obj_t *obj)
+{
+  obj->prev = NULL;
+  obj->next = cs->head;
+  if (cs->head)
+    cs->head->prev = obj;
+  cs->head = obj;
+  if (cs->tail == NULL)
+    cs->tail = obj;
+}
+
+/* mutex를 잡은 상태에서 호출 */
+static void bucket_unlink(cache_obj_t *obj)
+{
+  cache_obj_t **pp;
+
+  for (pp = &cs->buckets[obj->hash & (CACHE_BUCKETS - 1)]; *pp != obj; pp = &(*pp)->hnext)
+    ;
+  *pp = obj->hnext;
+}
+
+/* 리스트에서 빼고, 빌려간 쓰레드가 없으면 바로 해제한다. mutex를 잡은 상태에서 호출 */
+static void vary_free(vary_t *v);
+
+static void obj_remove(cache_obj_t *obj)
+{
+  list_unlink(obj);
+  bucket_unlink(obj);
+  if (obj->vary != NULL && --obj->vary->variants == 0)
+    vary_free(obj->vary);
+  obj->vary = NULL;
+  cs->bytes -= obj->size;
+  stats_add(STAT_BYTES_CACHED, -(long)obj->size);
+  if (obj->prefetched)
+  {
+    cs->prefetched -= obj->size;
+    prefetch_settle(obj->size, 0);
+  }
+  if (obj->refcnt == 0)
+    obj_free(obj);
+  else
+    obj->evicted = 1;
+}
+
+/* mutex를 잡은 상태에서 호출. hash = cachekey_hash(key) */
+static cache_obj_t *find(char *key, uint64_t hash)
+{
+  cache_obj_t *obj;
+
+  for (obj = cs->buckets[hash & (CACHE_BUCKETS - 1)]; obj != NULL; obj = obj->hnext)
+    if (obj->hash == hash && !strcmp(obj->key, key))
+      return obj;
+  return NULL;
+}
+
+/* mutex를 잡은 상태에서 호출 */
+static vary_t *vary_find(char *key, uint64_t hash)
+{
+  vary_t *v;
+
+  for (v = cs->vary_buckets[hash & (CACHE_BUCKETS - 1)]; v != NULL; v = v->hnext)
+    if (v->hash == hash && !strcmp(v->key, key))
+      return v;
+  return NULL;
+}
+
+static char *slot_get(size_t size);
+
+/* slot을 얻지 못하면 NULL. mutex를 잡은 상태에서 호출 */
+static vary_t *vary_new(char *key, uint64_t hash, char *names)
+{
+  size_t klen = strlen(key) + 1, nlen = strlen(names) + 1;
+  vary_t *v;
+
+  if ((v = (vary_t *)slot_get(sizeof(vary_t) + klen + nlen)) == NULL)
+    return NULL;
+  v->key = (char *)(v + 1);
+  memcpy(v->key, key, klen);
+  v->hash = hash;
+  v->names = v->key + klen;
+  memcpy(v->names, names, nlen);
+  v->variants = 0;
+  v->hnext = cs->vary_buckets[hash & (CACHE_BUCKETS - 1)];
+  cs->vary_buckets[hash & (CACHE_BUCKETS - 1)] = v;
+  return v;
+}
+
+/* 마지막 변형이 빠질 때 obj_remove()가 부른다 */
+static void vary_free(vary_t *v)
+{
+  vary_t **pp;
+
+  for (pp = &cs->vary_buckets[v->hash & (CACHE_BUCKETS - 1)]; *pp != v; pp = &(*pp)->hnext)
+    ;
+  *pp = v->hnext;
+  slab_free(v);
+}
+
+/* v의 변형을 오래 안 쓰인 것부터 keep개만 남기고 뺀다. keep이 0이면 v도 해제된다.
+   mutex를 잡은 상태에서 호출 */
+static void vary_trim(vary_t *v, int keep)
+{
+  cache_obj_t *obj, *prev;
+  int n = v->variants - keep;
+
+  for (obj = cs->tail; obj != NULL && n > 0; obj = prev)
+  {
+    prev = obj->prev;
+    if (obj->vary == v)
+    {
+      n--;
+      obj_remove(obj);
+      stats_inc(STAT_CACHE_EVICTIONS);
+    }
+  }
+}
+
+/* 응답 헤더의 Vary header 이름들을 소문자로 names에 잇는다.
+   없으면 0, 있으면 1, "*"이거나 너무 길면 -1 (캐시하지 않는다) */
+static int vary_names(char *data, size_t size, char *names)
+{
+  char *p, *end = data + size;
+  size_t n = 0;
+
+  names[0] = '\0';
+  for (p = data; p + 4 <= end && memcmp(p, "\r\n\r\n", 4); p++)
+  {
+    if (p + 7 > end || strncasecmp(p, "\r\nVary:", 7))
+      continue;
+    for (p += 7; p < end && *p != '\r'; p++)
+    {
+      if (*p == '*')
+        return -1;
+      if (*p == ' ' || *p == '\t')
+        continue;
+      if (*p == ',' && (n == 0 || names[n - 1] == ','))
+        continue;
+      if (n + 2 >= VARY_NAMES)
+        return -1;
+      names[n++] = tolower((unsigned char)*p);
+    }
+    /* 여러 Vary 줄은 이어 붙인다 */
+    if (n > 0 && names[n - 1] != ',')
+      names[n++] = ',';
+    p--;
+  }
+  if (n > 0 && names[n - 1] == ',')
+    n--;
+  names[n] = '\0';
+  return n > 0;
+}
+
+/* key 뒤에 names의 각 header에 대한 req의 값을 "\r\nname:value"로 붙여 out(cap 바이트)에 만든다.
+   변형 key의 뒷부분은 그 자체로 req처럼 읽을 수 있다(cache_restore). 넘치면 -1 */
+static int variant_key(char *key, char *names, char *req, char *out, size_t cap)
+{
+  char *name, *end, *line, *v;
+  size_t n = strlen(key), len, vlen;
+
+  if (n >= cap)
+    return -1;
+  memcpy(out, key, n);
+  for (name = names; *name; name = *end ? end + 1 : end)
+  {
+    end = name + strcspn(name, ",");
+    len = end - name;
+    vlen = 0;
+    v = NULL;
+    for (line = req; line != NULL && (line = strstr(line, "\r\n")) != NULL; line += 2)
+      if (!strncasecmp(line + 2, name, len) && line[len + 2] == ':')
+      {
+        for (v = line + len + 3; *v == ' ' || *v == '\t'; v++)
+          ;
+        vlen = strcspn(v, "\r\n");
+        break;
+      }
+    if (n + len + vlen + 4 > cap)
+      return -1;
+    memcpy(out + n, "\r\n", 2);
+    memcpy(out + n + 2, name, len);
+    out[n + 2 + len] = ':';
+    if (v != NULL)
+      memcpy(out + n + 3 + len, v, vlen);
+    n += len + vlen + 3;
+  }
+  out[n] = '\0';
+  return 0;
+}
+
+cache_obj_t *cache_lookup(char *key, char *req)
+{
+  cache_obj_t *obj = NULL;
+  vary_t *v;
+  uint64_t hash = cachekey_hash(key);
+  char vkey[MAXLINE];
+
+  lock();
+  if (cs->recovering)
+  {
+    /* 죽은 worker가 남긴 캐시를 비울 때까지는 모두 miss */
+    unlock();
+    stats_inc(STAT_CACHE_MISSES);
+    return NULL;
+  }
+  /* Vary로 나뉘는 URL이면 이 요청의 header 값으로 변형을 고른다 */
+  if ((v = vary_find(key, hash)) != NULL)
+  {
+    if (variant_key(key, v->names, req, vkey, sizeof(vkey)) == 0)
+    {
+      hash = cachekey_hash(vkey);
+      obj = find(vkey, hash);
+    }
+  }
+  else
+    obj = find(key, hash);
+  if (config_get()->tinylfu)
+    tinylfu_record(hash);
+  if (obj != NULL && obj->expires && obj->expires <= time(NULL))
+  {
+    obj_remove(obj);
+    obj = NULL;
+  }
+  if (obj != NULL)
+  {
+    list_unlink(obj);
+    list_push_front(obj);
+    obj->refcnt++;
+    cs->borrowed[me]++;
+    if (obj->prefetched)
+    {
+      obj->prefetched = 0;
+      cs->prefetched -= obj->size;
+      prefetch_settle(obj->size, 1);
+    }
+  }
+  unlock();
+
+  stats_inc(obj ? STAT_CACHE_HITS : STAT_CACHE_MISSES);
+  return obj;
+}
+
+int cache_contains(char *key)
+{
+  int found;
+  uint64_t hash = cachekey_hash(key);
+
+  lock();
+  found = !cs->recovering && (find(key, hash) != NULL || vary_find(key, hash) != NULL);
+  unlock();
+  return found;
+}
+
+void cache_release(cache_obj_t *obj)
+{
+  lock();
+  cs->borrowed[me]--;
+  /* 비우는 중이면 obj는 곧 통째로 버려진다 */
+  if (cs->recovering)
+    flush_if_idle();
+  else if (--obj->refcnt == 0 && obj->evicted)
+    obj_free(obj);
+  unlock();
+}
+
+/* 응답 헤더의 Cache-Control: max-age=N. 없으면 0 */
+static time_t max_age_expiry(char *data, size_t size, time_t now)
+{
+  char *p, *end = data + size;
+  long age;
+
+  for (p = data; p + 4 <= end && memcmp(p, "\r\n\r\n", 4); p++)
+    if (p + 16 <= end && !strncasecmp(p, "\r\nCache-Control:", 16))
+    {
+      for (p += 16; p + 8 <= end && *p != '\r'; p++)
+        if (!strncasecmp(p, "max-age=", 8))
+        {
+          age = strtol(p + 8, NULL, 10);
+          return now + (age > 0 ? age : 0); /* max-age=0이면 바로 만료 */
+        }
+      break;
+    }
+  return 0;
+}
+
+/* cls에 속한 객체 중 가장 오래 안 쓰인 것. 빌려간 쓰레드가 있는 객체는 evict해도 slot이
+   바로 비지 않으므로 건너뛴다. mutex를 잡은 상태에서 호출 */
+static cache_obj_t *class_victim(int cls)
+{
+  cache_obj_t *obj;
+
+  for (obj = cs->tail; obj != NULL; obj = obj->prev)
+    if (obj->refcnt == 0 && slab_class_of(obj) == cls)
+      return obj;
+  return NULL;
+}
+
+/* obj가 page [first, end)에 걸쳐 있으면 1 */
+static int on_pages(cache_obj_t *obj, int first, int end)
+{
+  int pg = slab_page_of(obj);
+
+  return pg < end && pg + slab_span_of(obj) > first;
+}
+
+/* page [first, end)에 걸친 객체를 모두 뺀다. mutex를 잡은 상태에서 호출 */
+static void evict_pages(int first, int end)
+{
+  cache_obj_t *obj, *prev;
+
+  for (obj = cs->tail; obj != NULL; obj = prev)
+  {
+    prev = obj->prev;
+    if (on_pages(obj, first, end))
+    {
+      obj_remove(obj);
+      stats_inc(STAT_CACHE_EVICTIONS);
+    }
+  }
+}
+
+/* 이어진 빈 page n개를 만들려고 비울 구간 [s, s+n)의 s. 빌려가지 않은 가장 오래된 객체의 page에
+   걸치는 구간들 중에서, 걸친 객체들의 LRU 순위(tail이 0) 합이 가장 작은 것, 즉 빈 page가 많고
+   오래된 객체만 든 구간을 고른다. n이 상한보다 크면 -1. mutex를 잡은 상태에서 호출 */
+static int pick_pages(int n)
+{
+  long diff[2 * RUN_MAX + 1], rank, sum, best = 0;
+  cache_obj_t *obj, *anchor = cs->tail;
+  int lo, hi, pg, from, to, s, first = -1;
+
+  for (obj = cs->tail; obj != NULL; obj = obj->prev)
+    if (obj->refcnt == 0)
+    {
+      anchor = obj;
+      break;
+    }
+  pg = slab_page_of(anchor);
+  lo = pg - n + 1 > 0 ? pg - n + 1 : 0;
+  hi = pg + slab_span_of(anchor) - 1 < slab_limit() - n ? pg + slab_span_of(anchor) - 1 : slab_limit() - n;
+  if (n > RUN_MAX || lo > hi)
+    return -1;
+
+  /* 객체가 page [pg, pg+span)에 있으면 s가 pg-n+1 .. pg+span-1일 때 구간과 겹친다 */
+  memset(diff, 0, (hi - lo + 2) * sizeof(long));
+  for (obj = cs->tail, rank = 0; obj != NULL; obj = obj->prev, rank++)
+  {
+    pg = slab_page_of(obj);
+    from = pg - n + 1 > lo ? pg - n + 1 : lo;
+    to = pg + slab_span_of(obj) - 1 < hi ? pg + slab_span_of(obj) - 1 : hi;
+    if (from > to)
+      continue;
+    diff[from - lo] += rank;
+    diff[to - lo + 1] -= rank;
+  }
+  for (s = lo, sum = 0; s <= hi; s++)
+  {
+    sum += diff[s - lo];
+    if (first < 0 || sum < best)
+    {
+      first = s;
+      best = sum;
+    }
+  }
+  return first;
+}
+
+/* 설정에서 cache_size가 줄었으면 새 상한 뒤의 page에 있는 객체를 모두 뺀다. mutex를 잡은 상태에서 호출 */
+static void fit_limit(void)
+{
+  if (slab_set_limit(config_get()->cache_size))
+    evict_pages(slab_limit(), INT_MAX);
+}
+
+/* size 바이트짜리 slot을 얻는다. 작은 slot은 같은 class의 빈 slot이나 빈 page가 없으면 먼저 그
+   class에서 LRU로 evict한다. class에 객체가 없거나 run이 필요하면 LRU tail 근처의 page 구간을
+   통째로 비운다(pick_pages). 모두 빌려간 상태라 더 비울 수 없으면 NULL. mutex를 잡은 상태에서 호출 */
+static char *slot_get(size_t size)
+{
+  cache_obj_t *victim;
+  char *slot;
+  int cls = slab_class(size), n = slab_pages(size), first;
+
+  fit_limit();
+  while ((slot = slab_alloc(size)) == NULL && cs->tail != NULL)
+  {
+    if (cls != SLAB_RUN && (victim = class_victim(cls)) != NULL)
+    {
+      obj_remove(victim);
+      stats_inc(STAT_CACHE_EVICTIONS);
+      continue;
+    }
+    if ((first = pick_pages(n)) < 0)
+      break;
+    evict_pages(first, first + n);
+  }
+  return slot;
+}
+
+/* 새 객체 때문에 밀려날 객체들보다 새 객체가 더 자주 쓰였을 때만 1. 밀려날 객체는 slot_get이
+   처음에 비우는 것과 같다: 같은 class의 victim 하나, 아니면 pick_pages가 고른 page 구간에 걸친
+   객체 모두이고, 이때는 그 추정 빈도의 합과 비교한다. 빌려간 객체나 Vary 정보가 남아 구간이 다
+   비지 않으면 slot_get은 더 비우지만 그만큼은 보지 않는다. mutex를 잡은 상태에서 호출 */
+static int admit(uint64_t hash, size_t size)
+{
+  cache_obj_t *victim, *obj;
+  int cls = slab_class(size), n = slab_pages(size), first;
+  long sum = 0;
+
+  fit_limit();
+  if (slab_has_room(size) || cs->tail == NULL)
+    return 1;
+  if (cls != SLAB_RUN && (victim = class_victim(cls)) != NULL)
+    return tinylfu_estimate(hash) > tinylfu_estimate(victim->hash);
+  if ((first = pick_pages(n)) < 0)
+    return 0;
+  for (obj = cs->tail; obj != NULL; obj = obj->prev)
+    if (on_pages(obj, first, first + n))
+      sum += tinylfu_estimate(obj->hash);
+  return tinylfu_estimate(hash) > sum;
+}
+
+/* 객체는 slab slot 하나에 [cache_obj_t][key\0][data]로 담는다. 모든 worker process가 보는
+   공유 메모리라 객체 전체가 한 곳에 있어야 한다.
+   check_admit이 0이면 (snapshot 복원) admission 없이 넣는다 */
+static void insert(char *key, char *req, char *data, size_t size, int prefetched, time_t stored, time_t expires, int check_admit)
+{
+  cache_obj_t *obj, *old;
+  vary_t *v;
+  uint64_t hash, url_hash = cachekey_hash(key);
+  char *slot = NULL, *url = key, names[VARY_NAMES], vkey[MAXLINE];
+  int rejected = 0, varies;
+  size_t klen, need;
+
+  if (size > (size_t)config_get()->max_object || (varies = vary_names(data, size, names)) < 0 ||
+      (varies && variant_key(url, names, req, vkey, sizeof(vkey)) < 0))
+  {
+    if (prefetched)
+      prefetch_settle(size, 0);
+    return;
+  }
+  /* 아래에서 key는 객체 자신의 key (Vary 변형이면 변형 key), url은 URL key */
+  if (varies)
+    key = vkey;
+  hash = cachekey_hash(key);
+  klen = strlen(key) + 1;
+  need = sizeof(cache_obj_t) + klen + size;
+
+  /* slot만 lock 안에서 확보한다. 같은 key가 이미 있으면 교체이므로 admission은 보지 않는다.
+     리스트에 넣을 때까지 slot은 이 process가 빌려간 것으로 센다 */
+  lock();
+  if (!cs->recovering)
+  {
+    if (config_get()->tinylfu && check_admit && find(key, hash) == NULL && !admit(hash, need))
+      rejected = 1;
+    else if ((slot = slot_get(need)) != NULL)
+      cs->borrowed[me]++;
+  }
+  unlock();
+  if (slot == NULL)
+  {
+    if (rejected)
+      stats_inc(STAT_CACHE_REJECTS);
+    if (prefetched)
+      prefetch_settle(size, 0);
+    return;
+  }
+
+  /* 복사는 lock 밖에서. slot은 이미 이 쓰레드 것이다 */
+  obj = (cache_obj_t *)slot;
+  obj->key = (char *)(obj + 1);
+  memcpy(obj->key, key, klen);
+  obj->data = obj->key + klen;
+  memcpy(obj->data, data, size);
+  obj->hash = hash;
+  obj->size = size;
+  obj->refcnt = 0;
+  obj->evicted = 0;
+  obj->prefetched = prefetched;
+  obj->stored = stored;
+  obj->expires = expires;
+  obj->vary = NULL;
+
+  lock();
+  cs->borrowed[me]--;
+  if (cs->recovering)
+  {
+    /* 그 사이에 다른 worker가 죽었다. slot은 비울 때 함께 버려진다 */
+    flush_if_idle();
+    unlock();
+    if (prefetched)
+      prefetch_settle(size, 0);
+    return;
+  }
+  /* 같은 key가 이미 있으면 새 객체로 교체 */
+  if ((old = find(key, hash)) != NULL)
+    obj_remove(old);
+  v = vary_find(url, url_hash);
+  if (!varies)
+  {
+    /* 더 이상 Vary가 없으면 이전 변형들은 버린다 */
+    if (v != NULL)
+      vary_trim(v, 0);
+  }
+  else
+  {
+    /* Vary가 없던 시절의 객체나 Vary 이름이 바뀌기 전의 변형은 다시 찾을 수 없다 */
+    if ((old = find(url, url_hash)) != NULL)
+      obj_remove(old);
+    if (v != NULL && strcmp(v->names, names))
+    {
+      vary_trim(v, 0);
+      v = NULL;
+    }
+    if (v == NULL && (v = vary_new(url, url_hash, names)) == NULL)
+    {
+      obj_free(obj);
+      unlock();
+      if (prefetched)
+        prefetch_settle(size, 0);
+      return;
+    }
+    /* 새 변형을 먼저 세어 두므로 trim 중에 v가 해제되지 않는다 */
+    obj->vary = v;
+    if (++v->variants > CACHE_VARIANTS)
+      vary_trim(v, CACHE_VARIANTS);
+  }
+  list_push_front(obj);
+  obj->hnext = cs->buckets[hash & (CACHE_BUCKETS - 1)];
+  cs->buckets[hash & (CACHE_BUCKETS - 1)] = obj;
+  cs->bytes += size;
+  if (prefetched)
+    cs->prefetched += size;
+  stats_add(STAT_BYTES_CACHED, size);
+  unlock();
+}
+
+int cache_status(char *data, size_t size)
+{
+  if (size < 12 || strncmp(data, "HTTP/", 5) || !isdigit((unsigned char)data[9]))
+    return 0;
+  return atoi(data + 9);
+}
+
+void cache_insert(char *key, char *req, char *data, size_t size, int prefetched)
+{
+  time_t now = time(NULL), expires = max_age_expiry(data, size, now);
+  int status = cache_status(data, size);
+
+  /* 오류 응답은 짧게만 둔다. TTL이 없으면 (cache_fill_ok를 거치지 않은 경우) 넣지 않는다 */
+  if (status != 200 && expires == 0)
+  {
+    if (negcache_status_ttl(status) <= 0)
+    {
+      if (prefetched)
+        prefetch_settle(size, 0);
+      return;
+    }
+    expires = now + negcache_status_ttl(status);
+  }
+  insert(key, req, data, size, prefetched, now, expires, 1);
+}
+
+void cache_restore(char *key, char *data, size_t size, time_t stored, time_t expires)
+{
+  char *sep = strstr(key, "\r\n"), *url;
+
+  if (sep == NULL)
+  {
+    insert(key, NULL, data, size, 0, stored, expires, 0);
+    return;
+  }
+  /* Vary 변형: 뒷부분의 header 값들로 같은 변형 key를 다시 만든다 */
+  url = Malloc(sep - key + 1);
+  memcpy(url, key, sep - key);
+  url[sep - key] = '\0';
+  insert(url, sep, data, size, 0, stored, expires, 0);
+  Free(url);
+}
+
+cache_obj_t **cache_borrow_all(int *n)
+{
+  cache_obj_t **objs, *obj;
+  int i = 0;
+
+  lock();
+  /* 비우는 중이면 빈 캐시로 본다 */
+  for (obj = cs->recovering ? NULL : cs->head; obj != NULL; obj = obj->next)
+    i++;
+  objs = Malloc((i + 1) * sizeof(cache_obj_t *));
+  for (i = 0, obj = cs->recovering ? NULL : cs->tail; obj != NULL; obj = obj->prev)
+  {
+    obj->refcnt++;
+    objs[i++] = obj;
+  }
+  cs->borrowed[me] += i;
+  unlock();
+  *n = i;
+  return objs;
+}
+
+void cache_fill_init(cache_fill_t *fill)
+{
+  fill->buf = NULL;
+  fill->len = fill->cap = 0;
+  fill->toobig = 0;
+}
+
+void cache_fill_free(cache_fill_t *fill)
+{
+  if (fill->buf)
+  {
+    Free(fill->buf);
+    budget_release(fill->cap);
+  }
+  cache_fill_init(fill);
+}
+
+int cache_fill_ok(cache_fill_t *fill)
+{
+  int status;
+
+  if (fill->toobig || (status = cache_status(fill->buf, fill->len)) == 0)
+    return 0;
+  return status == 200 || negcache_status_ttl(status) > 0;
+}
+
+void cache_fill(void *vfill, char *buf, size_t n)
+{
+  cache_fill_t *fill = vfill;
+  size_t cap;
+
+  if (fill->toobig)
+    return;
+  if (fill->len + n > fill->cap)
+  {
+    for (cap = fill->cap ? fill->cap : CACHE_FILL_INIT; cap < fill->len + n; cap *= 2)
+      ;
+    if (cap > (size_t)config_get()->max_object)
+      cap = config_get()->max_object;
+    /* 캐시할 수 없게 되면 모아둔 것도 바로 돌려준다 */
+    if (fill->len + n > cap || !budget_reserve(cap - fill->cap))
+    {
+      cache_fill_free(fill);
+      fill->toobig = 1;
+      return;
+    }
+    fill->buf = Realloc(fill->buf, cap);
+    fill->cap = cap;
+  }
+  memcpy(fill->buf + fill->len, buf, n);
+  fill->len += n;
+}
@@ -0,0 +1,110 @@
+/*
+ * cache.h - proxy의 웹 객체 캐시 (LRU)
+ *
+ * 객체는 end server의 응답 전체(헤더 + 본문)를 그대로 저장하고 정규화한 URI(cachekey.h)를
+ * key로 쓴다. key의 64비트 해시로 CACHE_BUCKETS개의 chain 중 하나만 찾아본다.
+ * lookup은 객체의 refcnt를 올려서 돌려주므로, 호출한 쓰레드는 lock 없이 객체를 client에게
+ * 보낼 수 있다. 그 사이에 객체가 evict되면 마지막 cache_release()에서 해제된다.
+ * 객체는 malloc 대신 slab.h의 slot 하나(작으면 size class, 크면 이어진 page run)에 구조체, key,
+ * 본문을 이어 담아, 캐시 메모리는 설정의 cache_size만큼의 slab page를 넘지 않는다.
+ *
+ * 색인, slab, tinylfu sketch는 모두 공유 메모리(shm.h)에 있고 lock은 process 공유 robust mutex라,
+ * cache_init() 뒤에 fork한 worker process들(proxy -m)이 캐시 하나를 함께 쓴다. worker가 lock을
+ * 쥔 채 죽거나, 빌려간 객체를 돌려주지 않고 죽으면 리스트를 믿을 수 없으므로 캐시를 비운다:
+ * 그동안 lookup은 모두 miss이고, 살아 있는 worker가 빌려간 객체를 모두 돌려주면 비운다.
+ *
+ * 응답에 Vary가 있으면 그 URL의 Vary header 이름들을 기억하고, 객체는 URL key 뒤에
+ * 요청의 해당 header 값들("\r\nname:value"...)을 붙인 변형 key로 저장한다. URL 하나의
+ * 변형은 CACHE_VARIANTS개까지이고 넘치면 그 URL에서 가장 오래 안 쓰인 변형을 뺀다.
+ * "Vary: *" 응답은 캐시하지 않는다.
+ */
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include "csapp.h"
+#include <time.h>
+#include <stdint.h>
+
+/* Recommended max cache and object sizes */
+#define MAX_CACHE_SIZE 1049000
+#define MAX_OBJECT_SIZE 102400
+
+/* 위 둘은 기본값이다. 실행 중에는 설정(config.h)의 cache_size와 max_object_size를 쓰고,
+   cache_size는 CACHE_SIZE_LIMIT까지 늘릴 수 있다 (그만큼의 주소 공간만 미리 잡는다) */
+#define CACHE_SIZE_LIMIT (1L << 30)
+
+#define CACHE_BUCKETS 1024 /* 해시 색인 크기 (2의 거듭제곱) */
+#define CACHE_VARIANTS 4   /* Vary로 나뉘는 URL 하나가 가질 수 있는 변형 수 */
+#define CACHE_PROCS 64     /* 캐시를 함께 쓸 수 있는 worker process 수 */
+
+struct vary;
+
+typedef struct cache_obj
+{
+  char *key;                     /* Vary 변형이면 URL key 뒤에 header 값들이 붙는다. 구조체 바로 뒤 */
+  uint64_t hash; /* cachekey_hash(key) */
+  char *data;                    /* key 바로 뒤 */
+  size_t size;
+  int refcnt;                    /* lookup으로 빌려간 쓰레드 수 (모든 process) */
+  int evicted;                   /* 리스트에서 빠졌지만 아직 빌려간 쓰레드가 있음 */
+  int prefetched;                /* prefetch.c가 넣었고 아직 한 번도 hit되지 않음 */
+  time_t stored;                 /* 캐시에 넣은 시각 */
+  time_t expires;                /* Cache-Control: max-age로 정한 만료 시각. 0이면 없음 */
+  struct cache_obj *prev, *next; /* LRU 리스트: head가 가장 최근에 쓰인 객체 */
+  struct cache_obj *hnext;       /* 같은 bucket의 다음 객체 */
+  struct vary *vary;             /* Vary 변형이면 그 URL의 Vary 정보 */
+} cache_obj_t;
+
+/* relay 중인 응답을 max_object_size(config.h)까지 모아두는 버퍼.
+   필요한 만큼만 늘리고, 늘릴 때마다 전역 메모리 예산(budget.h)에서 확보한다 */
+typedef struct
+{
+  char *buf;
+  size_t len, cap;
+  int toobig; /* max_object_size를 넘었거나 예산이 모자라 캐시할 수 없음 */
+} cache_fill_t;
+
+/* 캐시를 공유 메모리에 만든다. worker process를 fork하기 전에 */
+void cache_init(void);
+
+/* fork한 worker가 자기 번호(0 .. CACHE_PROCS-1)를 알린다. 부르지 않으면 0 */
+void cache_attach(int proc);
+
+/* proc번 worker가 끝났다(master가 부른다). 빌려간 객체를 남겼으면 캐시를 비운다 */
+void cache_reap(int proc);
+
+/* key에 해당하는 객체를 빌려온다. 없거나 만료됐으면 NULL. 다 쓰면 반드시 cache_release().
+   req는 end server로 보내는(보낼) request header 묶음으로, Vary 변형을 고를 때 쓴다. NULL이면
+   모든 header가 없는 요청으로 본다 */
+cache_obj_t *cache_lookup(char *key, char *req);
+void cache_release(cache_obj_t *obj);
+
+/* lookup과 달리 LRU 순서와 hit/miss 통계를 건드리지 않는다. Vary 변형이 하나라도 있으면 1 */
+int cache_contains(char *key);
+
+/* 응답 data의 status. HTTP 응답처럼 보이지 않으면 0 */
+int cache_status(char *data, size_t size);
+
+/* data를 복사해 캐시에 넣는다. 오류 응답은 max-age가 없으면 status별 negative TTL 동안만 둔다. 공간이 모자라면 같은 size class에서 LRU 순으로 evict하고,
+   그 class에 객체가 없으면 가장 오래된 객체의 slab page를 비워 넘겨받는다.
+   prefetched면 처음 hit되거나 evict될 때 prefetch_settle()로 알린다 */
+void cache_insert(char *key, char *req, char *data, size_t size, int prefetched);
+
+/* snapshot에서 읽은 객체를 시각 정보 그대로 넣는다 */
+void cache_restore(char *key, char *data, size_t size, time_t stored, time_t expires);
+
+/* 모든 객체를 LRU 역순(오래된 것부터)으로 빌려와 Malloc한 배열로 돌려준다.
+   각 객체를 cache_release()하고 배열을 Free해야 한다 */
+cache_obj_t **cache_borrow_all(int *n);
+
+void cache_fill_init(cache_fill_t *fill);
+void cache_fill_free(cache_fill_t *fill);
+
+/* 정상(200) 응답이나 negative TTL이 있는 오류 응답(negcache.h)을 끝까지 모았고
+   max_object_size 이하라 캐시할 수 있으면 1 */
+int cache_fill_ok(cache_fill_t *fill);
+
+/* relay_transfer()에 넘기는 sink. vfill은 cache_fill_t * */
+void cache_fill(void *vfill, char *buf, size_t n);
+
+#endif /* __CACHE_H__ */
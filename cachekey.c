@@ -0,0 +1,190 @@
+/*
+ * cachekey.c - 캐시 key 정규화와 해시
+ */
+#include "csapp.h"
+#include "cachekey.h"
+
+static int sort_query, drop_query;
+static char strip_names[CACHEKEY_STRIP_MAX][64];
+static int nstrip;
+
+int cachekey_rule(const char *spec)
+{
+  char buf[MAXLINE], *tok, *save;
+
+  if (!strcmp(spec, "sort"))
+    sort_query = 1;
+  else if (!strcmp(spec, "drop"))
+    drop_query = 1;
+  else if (!strncmp(spec, "strip=", 6) && strlen(spec) < MAXLINE)
+  {
+    strcpy(buf, spec + 6);
+    for (tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save))
+    {
+      if (nstrip == CACHEKEY_STRIP_MAX || strlen(tok) >= sizeof(strip_names[0]))
+        return -1;
+      strcpy(strip_names[nstrip++], tok);
+    }
+  }
+  else
+    return -1;
+  return 0;
+}
+
+static int hexval(int c)
+{
+  return isdigit(c) ? c - '0' : tolower(c) - 'a' + 10;
+}
+
+/* %XX 정규화. 결과는 입력보다 길어지지 않는다 */
+static void pct_normalize(const char *in, char *out)
+{
+  int c;
+
+  while (*in)
+  {
+    if (in[0] == '%' && isxdigit((unsigned char)in[1]) && isxdigit((unsigned char)in[2]))
+    {
+      c = hexval(in[1]) * 16 + hexval(in[2]);
+      if (isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~')
+        *out++ = c;
+      else
+      {
+        *out++ = '%';
+        *out++ = toupper((unsigned char)in[1]);
+        *out++ = toupper((unsigned char)in[2]);
+      }
+      in += 3;
+    }
+    else
+      *out++ = *in++;
+  }
+  *out = '\0';
+}
+
+/* RFC 3986 5.2.4 remove_dot_segments. in은 바꿔 쓰면서 읽는다 */
+static void remove_dots(char *in, char *out)
+{
+  char *o = out;
+
+  while (*in)
+  {
+    if (!strncmp(in, "../", 3))
+      in += 3;
+    else if (!strncmp(in, "./", 2))
+      in += 2;
+    else if (!strncmp(in, "/./", 3))
+      in += 2;
+    else if (!strcmp(in, "/."))
+      *++in = '/';
+    else if (!strncmp(in, "/../", 4) || !strcmp(in, "/.."))
+    {
+      /* "/../x" → "/x", "/.." → "/" 로 바꾸고 출력의 마지막 segment를 지운다 */
+      in += 2;
+      if (in[1] == '/')
+        in++;
+      else
+        *in = '/';
+      while (o > out && *--o != '/')
+        ;
+    }
+    else if (!strcmp(in, ".") || !strcmp(in, ".."))
+      in += strlen(in);
+    else
+    {
+      do
+        *o++ = *in++;
+      while (*in && *in != '/');
+    }
+  }
+  *o = '\0';
+}
+
+static int stripped(const char *param)
+{
+  size_t n = strcspn(param, "=");
+  int i;
+
+  for (i = 0; i < nstrip; i++)
+    if (strlen(strip_names[i]) == n && !strncmp(strip_names[i], param, n))
+      return 1;
+  return 0;
+}
+
+static int cmp_param(const void *a, const void *b)
+{
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* query의 parameter를 규칙대로 거른 뒤 out에 다시 잇는다 */
+static void normalize_query(char *query, char *out)
+{
+  char *params[CACHEKEY_PARAMS], *tok, *save;
+  int i, n = 0;
+
+  out[0] = '\0';
+  if (drop_query)
+    return;
+  /* parameter가 너무 많으면 규칙을 적용하지 않는다 */
+  strcpy(out, query);
+  if (!sort_query && nstrip == 0)
+    return;
+  for (tok = strtok_r(query, "&", &save); tok; tok = strtok_r(NULL, "&", &save))
+  {
+    if (n == CACHEKEY_PARAMS)
+      return;
+    if (!stripped(tok))
+      params[n++] = tok;
+  }
+  out[0] = '\0';
+  if (sort_query)
+    qsort(params, n, sizeof(char *), cmp_param);
+  for (i = 0; i < n; i++)
+  {
+    if (i)
+      strcat(out, "&");
+    strcat(out, params[i]);
+  }
+}
+
+int cachekey_build(const char *hostname, int port, const char *path, char *key, size_t cap)
+{
+  char buf[MAXLINE], dots[MAXLINE], query[MAXLINE], *q;
+  size_t len;
+  int i;
+
+  if (strlen(path) >= MAXLINE)
+    return -1;
+  pct_normalize(path, buf);
+  buf[strcspn(buf, "#")] = '\0';
+  query[0] = '\0';
+  if ((q = strchr(buf, '?')) != NULL)
+  {
+    *q = '\0';
+    normalize_query(q + 1, query);
+  }
+  remove_dots(buf, dots);
+
+  if (port == 80)
+    len = snprintf(key, cap, "http://%s%s%s%s", hostname, dots[0] == '/' ? "" : "/", dots, query[0] ? "?" : "");
+  else
+    len = snprintf(key, cap, "http://%s:%d%s%s%s", hostname, port, dots[0] == '/' ? "" : "/", dots, query[0] ? "?" : "");
+  if (len + strlen(query) >= cap)
+    return -1;
+  strcat(key, query);
+  for (i = 7; key[i] && key[i] != ':' && key[i] != '/'; i++)
+    key[i] = tolower((unsigned char)key[i]);
+  return 0;
+}
+
+uint64_t cachekey_hash(const char *key)
+{
+  uint64_t h = 14695981039346656037ULL;
+
+  while (*key)
+  {
+    h ^= (unsigned char)*key++;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
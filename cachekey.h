@@ -0,0 +1,30 @@
+/*
+ * cachekey.h - 캐시 key 정규화
+ *
+ * 같은 객체를 가리키는 URI가 모두 같은 key가 되도록 parse_uri()가 나눈 host, port, path로
+ * "http://host[:port]/path[?query]"를 다시 만든다.
+ *   - host는 소문자, 기본 포트(80)는 생략
+ *   - %XX 중 unreserved 문자(영숫자 - . _ ~)는 풀고, 나머지는 16진수를 대문자로
+ *   - path의 "."과 ".." segment를 없앤다 (RFC 3986 5.2.4)
+ *   - query는 -K 규칙에 따라 parameter를 정렬하거나 빼거나 통째로 버린다
+ * 캐시 색인은 key의 64비트 해시(cachekey_hash)로 찾는다.
+ */
+#ifndef __CACHEKEY_H__
+#define __CACHEKEY_H__
+
+#include "csapp.h"
+#include <stdint.h>
+
+#define CACHEKEY_STRIP_MAX 16 /* strip 규칙에 줄 수 있는 parameter 이름 수 */
+#define CACHEKEY_PARAMS 64    /* query에서 다루는 parameter 수. 넘으면 정렬하지 않는다 */
+
+/* "sort", "drop", "strip=name,name,..." 중 하나. 틀리면 -1 */
+int cachekey_rule(const char *spec);
+
+/* key에 정규화한 key(cap 바이트 이내)를 만든다. 넘치면 -1 (캐시하지 않는다) */
+int cachekey_build(const char *hostname, int port, const char *path, char *key, size_t cap);
+
+/* FNV-1a 64 */
+uint64_t cachekey_hash(const char *key);
+
+#endif /* __CACHEKEY_H__ */
@@ -0,0 +1,178 @@
+/*
+ * cachesim.c - 캐시 admission 정책(LRU, TinyLFU)을 비교하는 trace-driven simulator
+ *
+ * usage: ./cachesim [-t trace] [-n requests] [-u objects] [-z alpha] [-o fraction] [-s seed]
+ *
+ * trace 파일은 한 줄에 "key size" 하나. 주지 않으면 objects개의 객체에 Zipf(alpha) 분포로
+ * 요청을 만들고, 그중 fraction만큼은 다시 오지 않는 객체(one-hit wonder)로 바꾼다.
+ * 정책마다 fork해서 proxy의 cache.c에 같은 요청열을 그대로 넣고 hit ratio를 출력한다.
+ * util은 요청열의 뒤쪽 절반 동안 캐시에 든 응답 바이트가 cache_size에서 차지한 평균 비율이다.
+ * slab page를 쪼개 쓰며 버리는 공간이 적을수록 1에 가깝다.
+ */
+#include "csapp.h"
+#include "cache.h"
+#include "config.h"
+#include "stats.h"
+#include <math.h>
+
+typedef struct
+{
+  char *key;
+  int size;
+} req_t;
+
+static req_t *reqs;
+static int nreqs;
+
+static void load_trace(char *path)
+{
+  FILE *fp;
+  char key[MAXLINE];
+  int size, cap = 1024;
+
+  if ((fp = fopen(path, "r")) == NULL)
+    unix_error("cannot open trace");
+  reqs = Malloc(cap * sizeof(req_t));
+  while (fscanf(fp, "%8191s %d", key, &size) == 2)
+  {
+    if (nreqs == cap)
+      reqs = Realloc(reqs, (cap *= 2) * sizeof(req_t));
+    reqs[nreqs].key = strdup(key);
+    reqs[nreqs++].size = size;
+  }
+  fclose(fp);
+}
+
+/* 객체 i의 크기: 512B ~ 32KB 사이에서 객체마다 고정 */
+static int object_size(unsigned i)
+{
+  i = i * 2654435761u;
+  return (512 << (i % 7)) + (i >> 20) % 512;
+}
+
+static void make_trace(int n, int objects, double alpha, double once)
+{
+  double *cdf = Malloc(objects * sizeof(double)), sum = 0, r;
+  char key[MAXLINE];
+  int i, lo, hi, mid;
+
+  for (i = 0; i < objects; i++)
+    cdf[i] = sum += 1.0 / pow(i + 1, alpha);
+  reqs = Malloc(n * sizeof(req_t));
+  for (nreqs = 0; nreqs < n; nreqs++)
+  {
+    if (drand48() < once)
+    {
+      sprintf(key, "http://origin/once/%d", nreqs);
+      reqs[nreqs].size = object_size(objects + nreqs);
+    }
+    else
+    {
+      r = drand48() * sum;
+      for (lo = 0, hi = objects - 1; lo < hi;)
+      {
+        mid = (lo + hi) / 2;
+        if (cdf[mid] < r)
+          lo = mid + 1;
+        else
+          hi = mid;
+      }
+      sprintf(key, "http://origin/obj/%d", lo);
+      reqs[nreqs].size = object_size(lo);
+    }
+    reqs[nreqs].key = strdup(key);
+  }
+  Free(cdf);
+}
+
+static void replay(char *policy)
+{
+  static char body[MAX_OBJECT_SIZE];
+  cache_obj_t *obj;
+  long hits = 0, bytes = 0, hit_bytes = 0, stats[STAT_NR];
+  double util = 0;
+  int i;
+  config_t *config = config_new();
+
+  /* cache_insert()가 헤더에서 max-age를 찾으므로 응답처럼 보이게 */
+  strcpy(body, "HTTP/1.0 200 OK\r\nContent-length: 0\r\n\r\n");
+  cache_init();
+  config_set(config, "admission", policy);
+  config_install(config);
+  for (i = 0; i < nreqs; i++)
+  {
+    bytes += reqs[i].size;
+    if ((obj = cache_lookup(reqs[i].key, NULL)) != NULL)
+    {
+      hits++;
+      hit_bytes += reqs[i].size;
+      cache_release(obj);
+    }
+    else
+      cache_insert(reqs[i].key, NULL, body, reqs[i].size, 0);
+    if (i >= nreqs / 2)
+    {
+      stats_snapshot(stats);
+      util += (double)stats[STAT_BYTES_CACHED] / config->cache_size;
+    }
+  }
+  printf("%-8s requests %d hit_ratio %.4f byte_hit_ratio %.4f util %.3f\n", policy, nreqs,
+         (double)hits / nreqs, (double)hit_bytes / bytes, util / (nreqs - nreqs / 2));
+}
+
+int main(int argc, char **argv)
+{
+  char *trace = NULL, *policies[] = {"lru", "tinylfu"};
+  int opt, i, n = 200000, objects = 10000;
+  double alpha = 0.9, once = 0.3;
+  long seed = 1;
+
+  while ((opt = getopt(argc, argv, "t:n:u:z:o:s:")) != -1)
+  {
+    switch (opt)
+    {
+    case 't':
+      trace = optarg;
+      break;
+    case 'n':
+      n = atoi(optarg);
+      break;
+    case 'u':
+      objects = atoi(optarg);
+      break;
+    case 'z':
+      alpha = atof(optarg);
+      break;
+    case 'o':
+      once = atof(optarg);
+      break;
+    case 's':
+      seed = atol(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-t trace] [-n requests] [-u objects] [-z alpha] [-o fraction] [-s seed]\n", argv[0]);
+      exit(1);
+    }
+  }
+  if (trace)
+    load_trace(trace);
+  else
+  {
+    srand48(seed);
+    make_trace(n, objects, alpha, once);
+    printf("zipf alpha %.2f, %d objects, %.0f%% one-hit wonders, cache %d bytes\n", alpha, objects, once * 100, MAX_CACHE_SIZE);
+  }
+  fflush(stdout);
+
+  /* 정책마다 깨끗한 캐시에서 시작하도록 자식 프로세스에서 돌린다 */
+  for (i = 0; i < 2; i++)
+  {
+    if (Fork() == 0)
+    {
+      replay(policies[i]);
+      exit(0);
+    }
+    Wait(NULL);
+  }
+  return 0;
+}
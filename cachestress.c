@@ -0,0 +1,395 @@
+/*
+ * cachestress.c - 여러 쓰레드로 proxy의 cache.c를 두드리며 불변식을 확인하는 stress harness
+ *
+ * usage: ./cachestress [-t threads] [-d seconds] [-k keys] [-A lru|tinylfu] [-s seed]
+ *
+ * 쓰레드마다 겹치는 key 집합(앞쪽 key일수록 자주)에 다음을 섞어 보낸다.
+ *   lookup  cache_lookup 후 내용 일부를 확인하고 release
+ *   insert  새 version으로 cache_insert (같은 key면 교체, 공간이 모자라면 evict)
+ *   hold    lookup한 객체를 다른 쓰레드들이 evict하는 동안 쥐고 있다가 전체를 다시 확인
+ *   purge   cache_size를 임의로 줄이거나 되돌린 설정을 config_install (SIGHUP reload와 같은 길)
+ * 따로 도는 checker 쓰레드는 cache_borrow_all()로 캐시 전체를 빌려 확인한다.
+ *
+ * 확인하는 불변식:
+ *   bytes       리스트에 있는 객체 크기 합 <= MAX_CACHE_SIZE, 끝나면 통계(bytes_cached)와 일치,
+ *               slab page <= MAX_CACHE_SIZE
+ *   torn        객체 내용이 그 key와 version으로 만든 것과 바이트 단위로 같다 (크기 포함)
+ *   evict       빌린 동안 evict되어도 내용이 바뀌지 않는다 (slot이 다른 객체에 다시 쓰이지 않음)
+ *   duplicate   같은 key가 리스트에 두 번 있지 않다
+ *
+ * 쓰레드 수 1, 2, 4, ...에서 -t까지 각각 깨끗한 캐시(자식 프로세스)로 -d초씩 돌려 ops/s와
+ * 1 쓰레드 대비 배율을 출력한다. 불변식이 하나라도 깨지면 종료 코드가 1이다.
+ */
+#include "csapp.h"
+#include "cache.h"
+#include "config.h"
+#include "slab.h"
+#include "stats.h"
+#include "hist.h"
+
+#define DEFAULT_KEYS 4096
+#define DEFAULT_SECONDS 1
+#define MAX_THREADS 64
+#define CHECK_MS 20       /* checker가 캐시 전체를 확인하는 간격 */
+#define HOLD_SPINS 64     /* hold 동안 양보하는 횟수 */
+#define SAMPLES 16        /* lookup에서 확인하는 본문 위치 수 */
+#define MAX_REPORTS 10    /* stderr에 자세히 남기는 위반 수 */
+
+/* 1000번 중 몇 번 */
+#define MIX_INSERT 250
+#define MIX_HOLD 20
+#define MIX_PURGE 1
+
+typedef enum
+{
+  V_BYTES,
+  V_TORN,
+  V_EVICT,
+  V_DUPLICATE,
+  V_NR
+} violation_t;
+
+static const char *violation_names[V_NR] = {"bytes", "torn", "evict", "duplicate"};
+
+typedef struct
+{
+  unsigned long long rng;
+  long lookups, hits, inserts, holds, purges;
+} __attribute__((aligned(64))) worker_t;
+
+static worker_t workers[MAX_THREADS];
+static int nkeys = DEFAULT_KEYS;
+static char *admission = "lru";
+static long *versions;            /* atomic: key마다 마지막으로 넣은 version */
+static long violations[V_NR];     /* atomic */
+static long reported;             /* atomic */
+static long checks;
+static volatile int running;
+
+static void violation(violation_t v, const char *fmt, long a, long b)
+{
+  __atomic_fetch_add(&violations[v], 1, __ATOMIC_RELAXED);
+  if (__atomic_fetch_add(&reported, 1, __ATOMIC_RELAXED) < MAX_REPORTS)
+  {
+    fprintf(stderr, "violation %s: ", violation_names[v]);
+    fprintf(stderr, fmt, a, b);
+    fprintf(stderr, "\n");
+  }
+}
+
+static unsigned long long next_rand(worker_t *w)
+{
+  w->rng ^= w->rng << 13;
+  w->rng ^= w->rng >> 7;
+  w->rng ^= w->rng << 17;
+  return w->rng;
+}
+
+/* 앞쪽 key일수록 자주 (u^3) */
+static int pick_key(worker_t *w)
+{
+  double u = (next_rand(w) >> 11) * (1.0 / 9007199254740992.0);
+
+  return (int)(u * u * u * nkeys);
+}
+
+/* key k의 객체 크기: 512B ~ 32KB 사이에서 key마다 고정 (cachesim과 같은 분포) */
+static int object_size(unsigned k)
+{
+  k = k * 2654435761u;
+  return (512 << (k % 7)) + (k >> 20) % 512;
+}
+
+static void key_of(int k, char *key)
+{
+  sprintf(key, "http://stress/obj/%d", k);
+}
+
+static unsigned char pattern(long k, long version, size_t i)
+{
+  return (unsigned char)((k * 131 + version * 7919 + i * 31) >> 3);
+}
+
+/* 헤더에 key와 version을 적고, 본문은 둘로 정해지는 무늬로 채운다. 전체 길이를 반환 */
+static int make_object(int k, long version, char *buf)
+{
+  int size = object_size(k), len, i;
+
+  len = sprintf(buf, "HTTP/1.0 200 OK\r\nX-Key: %d\r\nX-Version: %ld\r\nContent-length: %d\r\n\r\n", k, version, size);
+  for (i = 0; i < size; i++)
+    buf[len + i] = pattern(k, version, i);
+  return len + size;
+}
+
+/* data가 key k의 어떤 version으로 만든 객체인지 확인한다. full이면 본문 전체, 아니면 SAMPLES곳만.
+   맞으면 version, 아니면 -1 */
+static long verify(int k, char *data, size_t size, int full)
+{
+  char *body;
+  int key, len, i, step;
+  long version;
+
+  if (size < 16 || strncmp(data, "HTTP/1.0 200 OK\r\n", 17) ||
+      sscanf(data, "HTTP/1.0 200 OK\r\nX-Key: %d\r\nX-Version: %ld\r\nContent-length: %d", &key, &version, &len) != 3 ||
+      key != k || len != object_size(k) || (body = strstr(data, "\r\n\r\n")) == NULL)
+    return -1;
+  body += 4;
+  if (body + len != data + size)
+    return -1;
+  step = full ? 1 : len / SAMPLES;
+  for (i = 0; i < len; i += step)
+    if ((unsigned char)body[i] != pattern(k, version, i))
+      return -1;
+  return (unsigned char)body[len - 1] == pattern(k, version, len - 1) ? version : -1;
+}
+
+static void do_lookup(worker_t *w, int hold)
+{
+  char key[MAXLINE];
+  cache_obj_t *obj;
+  long version;
+  int k = pick_key(w), i;
+
+  key_of(k, key);
+  w->lookups++;
+  if ((obj = cache_lookup(key, NULL)) == NULL)
+    return;
+  w->hits++;
+  if ((version = verify(k, obj->data, obj->size, hold)) < 0)
+    violation(V_TORN, "key %ld, size %ld", k, (long)obj->size);
+  else if (hold)
+  {
+    /* 쥐고 있는 동안 다른 쓰레드가 evict하고 slot을 다시 써도 이 객체는 그대로여야 한다 */
+    w->holds++;
+    for (i = 0; i < HOLD_SPINS; i++)
+      sched_yield();
+    if (verify(k, obj->data, obj->size, 1) != version || strcmp(obj->key, key))
+      violation(V_EVICT, "key %ld changed while borrowed (version %ld)", k, version);
+  }
+  cache_release(obj);
+}
+
+static void do_insert(worker_t *w)
+{
+  static __thread char *buf;
+  char key[MAXLINE];
+  int k = pick_key(w), len;
+
+  if (buf == NULL)
+    buf = Malloc(MAX_OBJECT_SIZE);
+  key_of(k, key);
+  len = make_object(k, __atomic_add_fetch(&versions[k], 1, __ATOMIC_RELAXED), buf);
+  w->inserts++;
+  cache_insert(key, NULL, buf, len, 0);
+}
+
+/* cache_size를 SLAB_PAGE*2 ~ MAX_CACHE_SIZE 사이의 임의 값으로 바꾼다. 넘친 page는 다음 insert가 비운다 */
+static void do_purge(worker_t *w)
+{
+  config_t *c = config_new();
+  char size[32];
+
+  sprintf(size, "%ld", (long)(2 * SLAB_PAGE + next_rand(w) % (MAX_CACHE_SIZE - 2 * SLAB_PAGE + 1)));
+  config_set(c, "cache_size", size);
+  config_set(c, "admission", admission);
+  config_install(c);
+  w->purges++;
+}
+
+static void *worker(void *vargp)
+{
+  worker_t *w = vargp;
+  unsigned r;
+
+  while (running)
+  {
+    /* proxy worker처럼 요청 사이에서 새 설정으로 옮겨 간다 */
+    config_refresh();
+    r = next_rand(w) % 1000;
+    if (r < MIX_PURGE)
+      do_purge(w);
+    else if (r < MIX_PURGE + MIX_HOLD)
+      do_lookup(w, 1);
+    else if (r < MIX_PURGE + MIX_HOLD + MIX_INSERT)
+      do_insert(w);
+    else
+      do_lookup(w, 0);
+  }
+  return NULL;
+}
+
+/* 캐시 전체를 빌려서 확인한다. 리스트에 있는 바이트 수를 반환 */
+static long check_all(void)
+{
+  cache_obj_t **objs;
+  char *seen = Calloc(nkeys, 1);
+  long bytes = 0;
+  int n, i, k;
+
+  objs = cache_borrow_all(&n);
+  for (i = 0; i < n; i++)
+  {
+    bytes += objs[i]->size;
+    if (sscanf(objs[i]->key, "http://stress/obj/%d", &k) != 1 || k < 0 || k >= nkeys ||
+        verify(k, objs[i]->data, objs[i]->size, 1) < 0)
+    {
+      violation(V_TORN, "object %ld of %ld in the cache", i, n);
+      continue;
+    }
+    if (seen[k]++)
+      violation(V_DUPLICATE, "key %ld listed twice (%ld objects)", k, n);
+  }
+  if (bytes > MAX_CACHE_SIZE)
+    violation(V_BYTES, "%ld bytes cached > %ld", bytes, MAX_CACHE_SIZE);
+  for (i = 0; i < n; i++)
+    cache_release(objs[i]);
+  Free(objs);
+  Free(seen);
+  checks++;
+  return bytes;
+}
+
+static void *checker(void *vargp)
+{
+  while (running)
+  {
+    usleep(CHECK_MS * 1000);
+    check_all();
+  }
+  return NULL;
+}
+
+/* 깨끗한 캐시로 threads개를 seconds 동안 돌린다. ops/s를 반환하고 위반이 있으면 *failed */
+static double run(int threads, double seconds, long seed, int *failed)
+{
+  pthread_t tids[MAX_THREADS], ctid;
+  config_t *c = config_new();
+  long stats[STAT_NR], lookups = 0, hits = 0, inserts = 0, holds = 0, purges = 0, bytes, total = 0;
+  long long start, elapsed;
+  int i;
+
+  versions = Calloc(nkeys, sizeof(long));
+  cache_init();
+  config_set(c, "admission", admission);
+  config_install(c);
+
+  running = 1;
+  for (i = 0; i < threads; i++)
+  {
+    memset(&workers[i], 0, sizeof(worker_t));
+    workers[i].rng = (seed + i) * 0x9E3779B97F4A7C15ULL | 1;
+    Pthread_create(&tids[i], NULL, worker, &workers[i]);
+  }
+  Pthread_create(&ctid, NULL, checker, NULL);
+  start = hist_now();
+  usleep((useconds_t)(seconds * 1e6));
+  running = 0;
+  for (i = 0; i < threads; i++)
+    Pthread_join(tids[i], NULL);
+  elapsed = hist_now() - start;
+  Pthread_join(ctid, NULL);
+
+  /* 모두 멈춘 뒤: 통계와 리스트가 같고, 마지막 purge로 넘친 page도 원래 크기로 돌아와야 한다 */
+  c = config_new();
+  config_set(c, "admission", admission);
+  config_install(c);
+  bytes = check_all();
+  stats_snapshot(stats);
+  if (stats[STAT_BYTES_CACHED] != bytes)
+    violation(V_BYTES, "bytes_cached stat %ld != %ld bytes listed", stats[STAT_BYTES_CACHED], bytes);
+  if (stats[STAT_CACHE_SLAB_BYTES] > MAX_CACHE_SIZE)
+    violation(V_BYTES, "slab bytes %ld > %ld", stats[STAT_CACHE_SLAB_BYTES], MAX_CACHE_SIZE);
+
+  for (i = 0; i < threads; i++)
+  {
+    lookups += workers[i].lookups;
+    hits += workers[i].hits;
+    inserts += workers[i].inserts;
+    holds += workers[i].holds;
+    purges += workers[i].purges;
+  }
+  total = lookups + inserts + purges;
+  printf("%7d %12.0f %9.1f%% %10ld %9ld %7ld %7ld %7ld", threads, total / (elapsed / 1e9),
+         lookups ? 100.0 * hits / lookups : 0.0, inserts, holds, purges, checks, bytes);
+  for (i = 0; i < V_NR; i++)
+    if (violations[i])
+    {
+      printf("  %s=%ld", violation_names[i], violations[i]);
+      *failed = 1;
+    }
+  return total / (elapsed / 1e9);
+}
+
+int main(int argc, char **argv)
+{
+  int opt, threads, failed, status, rc = 0, max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  double seconds = DEFAULT_SECONDS, *results, ops;
+  long seed = 1;
+
+  while ((opt = getopt(argc, argv, "t:d:k:A:s:")) != -1)
+  {
+    switch (opt)
+    {
+    case 't':
+      max_threads = atoi(optarg);
+      break;
+    case 'd':
+      seconds = atof(optarg);
+      break;
+    case 'k':
+      nkeys = atoi(optarg);
+      break;
+    case 'A':
+      admission = optarg;
+      break;
+    case 's':
+      seed = atol(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-t threads] [-d seconds] [-k keys] [-A lru|tinylfu] [-s seed]\n", argv[0]);
+      exit(1);
+    }
+  }
+  if (max_threads < 1)
+    max_threads = 1;
+  if (max_threads > MAX_THREADS)
+    max_threads = MAX_THREADS;
+  if (seconds <= 0 || nkeys < 1 || (strcmp(admission, "lru") && strcmp(admission, "tinylfu")))
+  {
+    fprintf(stderr, "%s: bad argument\n", argv[0]);
+    exit(1);
+  }
+
+  /* 자식이 적은 ops/s를 부모가 읽어 배율을 계산한다 */
+  results = mmap(NULL, sizeof(double) * (MAX_THREADS + 1), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  printf("%d keys, %s admission, %.1f s per run, cache %d bytes\n", nkeys, admission, seconds, MAX_CACHE_SIZE);
+  printf("%7s %12s %10s %10s %9s %7s %7s %7s %8s\n", "threads", "ops/s", "hit", "inserts", "holds", "purges",
+         "checks", "bytes", "speedup");
+  fflush(stdout);
+
+  /* 1, 2, 4, ... max_threads. 쓰레드 수마다 깨끗한 캐시에서 시작하도록 자식 프로세스에서 돌린다 */
+  for (threads = 1;; threads *= 2)
+  {
+    if (threads > max_threads)
+      threads = max_threads;
+    if (Fork() == 0)
+    {
+      failed = 0;
+      ops = run(threads, seconds, seed, &failed);
+      results[threads] = ops;
+      printf(" %7.2fx\n", results[1] > 0 ? ops / results[1] : 1.0);
+      exit(failed);
+    }
+    Wait(&status);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+      if (!WIFEXITED(status))
+        printf("\n%d threads: killed by signal %d\n", threads, WTERMSIG(status));
+      rc = 1;
+    }
+    if (threads == max_threads)
+      break;
+  }
+  printf("%s\n", rc ? "FAILED: cache invariants violated" : "ok: no invariant violations");
+  return rc;
+}
@@ -0,0 +1,309 @@
+/*
+ * config.c - 설정 파일 읽기, 세대별 config_t 교체와 회수
+ */
+#include "csapp.h"
+#include <limits.h>
+#include "config.h"
+#include "cache.h"
+#include "slab.h"
+#include "relay.h"
+#include "budget.h"
+#include "drain.h"
+#include "stats.h"
+#include "log.h"
+
+static config_t *base;        /* 명령줄로 채운 설정. 다시 읽을 때마다 여기서 시작한다 */
+static const char *conf_path; /* NULL이면 다시 읽지 않는다 */
+static sigset_t hup_set;
+
+static config_t *current;                                /* lock이 보호 */
+static long generation;                                  /* atomic: current->generation */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER; /* 교체와 참조 획득만 */
+static __thread config_t *mine;                          /* 이 쓰레드가 쥐고 있는 설정 */
+
+config_t *config_new(void)
+{
+  config_t *c = Calloc(1, sizeof(config_t));
+
+  c->connect_ms = DEFAULT_CONNECT_MS;
+  c->first_byte_ms = DEFAULT_FIRST_BYTE_MS;
+  c->idle_ms = DEFAULT_IDLE_MS;
+  c->header_ms = DEFAULT_HEADER_MS;
+  c->drain_ms = DEFAULT_DRAIN_MS;
+  c->mem_budget = DEFAULT_MEM_BUDGET;
+  c->cache_size = MAX_CACHE_SIZE;
+  c->max_object = MAX_OBJECT_SIZE;
+  c->log_level = LOG_INFO;
+  negcache_config(&c->neg, DEFAULT_NEG_SPEC);
+  c->pools = pool_table_new();
+  return c;
+}
+
+static config_t *copy(config_t *c)
+{
+  config_t *n = Malloc(sizeof(config_t));
+
+  memcpy(n, c, sizeof(config_t));
+  n->generation = 0;
+  n->refcnt = 0;
+  n->pools = pool_table_copy(c->pools);
+  return n;
+}
+
+static void config_free(config_t *c)
+{
+  pool_table_free(c->pools);
+  Free(c);
+}
+
+static void put(config_t *c)
+{
+  if (__atomic_sub_fetch(&c->refcnt, 1, __ATOMIC_ACQ_REL) == 0)
+    config_free(c);
+}
+
+/* 0 이상의 10진수만 */
+static int number(const char *s, long *v)
+{
+  char *end;
+
+  if (!isdigit((unsigned char)*s))
+    return -1;
+  errno = 0;
+  *v = strtol(s, &end, 10);
+  return *end != '\0' || errno ? -1 : 0;
+}
+
+int config_set(config_t *c, const char *key, const char *value)
+{
+  long v;
+  int level;
+
+  if (!strcmp(key, "pool"))
+    return pool_define(c->pools, value);
+  if (!strcmp(key, "route"))
+    return pool_route_add(c->pools, value);
+  if (!strcmp(key, "balance"))
+    return pool_set_balance(c->pools, value);
+  if (!strcmp(key, "negative"))
+    return negcache_config(&c->neg, value);
+  if (!strcmp(key, "admission"))
+  {
+    if (!strcasecmp(value, "lru"))
+      c->tinylfu = 0;
+    else if (!strcasecmp(value, "tinylfu"))
+      c->tinylfu = 1;
+    else
+      return -1;
+    return 0;
+  }
+  if (!strcmp(key, "log_level"))
+  {
+    if ((level = log_parse_level(value)) < 0)
+      return -1;
+    c->log_level = level;
+    return 0;
+  }
+
+  /* 나머지는 모두 숫자 */
+  if (number(value, &v) < 0)
+    return -1;
+  if (!strcmp(key, "connect_ms") && v <= INT_MAX)
+    c->connect_ms = v;
+  else if (!strcmp(key, "first_byte_ms") && v <= INT_MAX)
+    c->first_byte_ms = v;
+  else if (!strcmp(key, "idle_ms") && v <= INT_MAX)
+    c->idle_ms = v;
+  else if (!strcmp(key, "header_ms") && v <= INT_MAX)
+    c->header_ms = v;
+  else if (!strcmp(key, "drain_ms") && v <= INT_MAX)
+    c->drain_ms = v;
+  else if (!strcmp(key, "mem_budget") && v > 0)
+    c->mem_budget = v;
+  else if (!strcmp(key, "cache_size") && v >= SLAB_PAGE && v <= CACHE_SIZE_LIMIT)
+    c->cache_size = v;
+  else if (!strcmp(key, "max_object_size") && v > 0 && v <= MAX_OBJECT_SIZE)
+    c->max_object = v;
+  else if (!strcmp(key, "range_fill") && v <= 1)
+    c->range_fill = v;
+  else
+    return -1;
+  return 0;
+}
+
+/* path의 줄들을 c에 덮어쓴다. 다 맞으면 0, 잘못된 줄이 있으면 그 줄 번호, 못 읽으면 -1 */
+static int load(config_t *c, const char *path)
+{
+  FILE *fp;
+  char line[MAXLINE], *key, *value, *p;
+  int lineno = 0, cleared = 0, bad = 0;
+
+  if ((fp = fopen(path, "r")) == NULL)
+    return -1;
+  while (fgets(line, sizeof(line), fp) != NULL)
+  {
+    lineno++;
+    if ((p = strchr(line, '#')) != NULL)
+      *p = '\0';
+    key = line + strspn(line, " \t\r\n");
+    if (*key == '\0')
+      continue;
+    p = key + strcspn(key, " \t=\r\n");
+    value = p + strspn(p, " \t=");
+    *p = '\0';
+    for (p = value + strlen(value); p > value && isspace((unsigned char)p[-1]); p--)
+      ;
+    *p = '\0';
+    /* pool과 route는 줄마다 더해지므로, 파일에 있으면 명령줄 것을 먼저 비운다 */
+    if ((!strcmp(key, "pool") || !strcmp(key, "route")) && !cleared++)
+      pool_table_clear(c->pools);
+    if (config_set(c, key, value) < 0)
+    {
+      bad = lineno;
+      break;
+    }
+  }
+  fclose(fp);
+  return bad;
+}
+
+/* base에 설정 파일을 덮어쓴 새 설정. 틀리면 NULL이고 msg에 이유 */
+static config_t *build(char *msg)
+{
+  config_t *c = copy(base);
+  int rc = conf_path ? load(c, conf_path) : 0;
+
+  if (rc < 0)
+    sprintf(msg, "%s: cannot read", conf_path);
+  else if (rc > 0)
+    sprintf(msg, "%s:%d: bad line", conf_path, rc);
+  else if (pool_check(c->pools) < 0)
+    sprintf(msg, "%s: route to unknown pool", conf_path ? conf_path : "config");
+  else
+    return c;
+  config_free(c);
+  return NULL;
+}
+
+void config_install(config_t *c)
+{
+  config_t *old;
+
+  pthread_mutex_lock(&lock);
+  old = current;
+  c->generation = old ? old->generation + 1 : 1;
+  c->refcnt = 1;
+  current = c;
+  __atomic_store_n(&generation, c->generation, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&lock);
+  if (old)
+    put(old);
+  log_level = c->log_level;
+  config_refresh();
+}
+
+void config_refresh(void)
+{
+  config_t *old = mine;
+
+  if (old != NULL && old->generation == __atomic_load_n(&generation, __ATOMIC_ACQUIRE))
+    return;
+  pthread_mutex_lock(&lock);
+  mine = current;
+  __atomic_add_fetch(&mine->refcnt, 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&lock);
+  if (old != NULL)
+    put(old);
+}
+
+config_t *config_get(void)
+{
+  if (mine == NULL)
+    config_refresh();
+  return mine;
+}
+
+int config_init(config_t *c, const char *path)
+{
+  char msg[MAXLINE];
+  config_t *first;
+
+  base = c;
+  conf_path = path;
+  if ((first = build(msg)) == NULL)
+  {
+    fprintf(stderr, "%s\n", msg);
+    return -1;
+  }
+  if (path != NULL)
+  {
+    sigemptyset(&hup_set);
+    sigaddset(&hup_set, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &hup_set, NULL);
+  }
+  config_install(first);
+  return 0;
+}
+
+/* 실패하면 지금 설정을 그대로 둔다 */
+void config_reload(void)
+{
+  char msg[MAXLINE];
+  config_t *c;
+
+  config_refresh();
+  if ((c = build(msg)) == NULL)
+  {
+    stats_inc(STAT_CONFIG_ERRORS);
+    LOGF(LOG_WARN, "%s, keeping configuration generation %ld", msg, mine->generation);
+    return;
+  }
+  /* 같은 backend의 health 상태는 이어서 쓴다 */
+  pool_table_inherit(c->pools, mine->pools);
+  config_install(c);
+  stats_inc(STAT_CONFIG_RELOADS);
+  LOGF(LOG_INFO, "%s reloaded, configuration generation %ld", conf_path, c->generation);
+}
+
+static void *reload_thread(void *vargp)
+{
+  Pthread_detach(pthread_self());
+  while (1)
+    if (sigwaitinfo(&hup_set, NULL) == SIGHUP)
+      config_reload();
+  return NULL;
+}
+
+void config_start(void)
+{
+  pthread_t tid;
+
+  if (conf_path != NULL)
+    Pthread_create(&tid, NULL, reload_thread, NULL);
+}
+
+void config_report(FILE *out, int json)
+{
+  config_t *c = config_get();
+  char neg[MAXBUF];
+  const char *admission = c->tinylfu ? "tinylfu" : "lru";
+  const char *level = log_level_name(c->log_level);
+
+  negcache_format(&c->neg, neg);
+  if (json)
+    fprintf(out, "\"generation\": %ld, \"file\": \"%s\", \"connect_ms\": %d, \"first_byte_ms\": %d, "
+                 "\"idle_ms\": %d, \"header_ms\": %d, \"drain_ms\": %d, \"mem_budget\": %ld, \"cache_size\": %ld, \"max_object_size\": %ld, "
+                 "\"admission\": \"%s\", \"range_fill\": %d, \"negative\": \"%s\", \"log_level\": \"%s\", "
+                 "\"balance\": \"%s\"",
+            c->generation, conf_path ? conf_path : "", c->connect_ms, c->first_byte_ms, c->idle_ms, c->header_ms, c->drain_ms,
+            c->mem_budget, c->cache_size, c->max_object, admission, c->range_fill, neg, level,
+            pool_balance_name(c->pools));
+  else
+    fprintf(out, "config_generation %ld\nconfig_file %s\nconfig_connect_ms %d\nconfig_first_byte_ms %d\n"
+                 "config_idle_ms %d\nconfig_header_ms %d\nconfig_drain_ms %d\nconfig_mem_budget %ld\nconfig_cache_size %ld\nconfig_max_object_size %ld\n"
+                 "config_admission %s\nconfig_range_fill %d\nconfig_negative %s\nconfig_log_level %s\n"
+                 "config_balance %s\n",
+            c->generation, conf_path ? conf_path : "-", c->connect_ms, c->first_byte_ms, c->idle_ms, c->header_ms, c->drain_ms,
+            c->mem_budget, c->cache_size, c->max_object, admission, c->range_fill, neg, level,
+            pool_balance_name(c->pools));
+}
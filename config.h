@@ -0,0 +1,92 @@
+/*
+ * config.h - 실행 중에 다시 읽을 수 있는 proxy 설정
+ *
+ * deadline, 메모리 예산, 캐시 크기와 객체 크기 상한, admission 정책, negative TTL, 로그 레벨,
+ * backend pool/route처럼 실행 중에 바꿀 수 있는 값은 모두 config_t 하나에 모은다.
+ * config_t는 만든 뒤로 바꾸지 않는다. SIGHUP을 받으면 설정 파일(-f)로 새 config_t를 통째로
+ * 만들어 전역 포인터만 바꿔 끼운다(RCU). 각 쓰레드는 요청과 요청 사이에서 config_refresh()로만
+ * 새 세대로 옮겨 가므로 요청 하나는 끝까지 같은 설정을 보고, 처리 중인 연결과 캐시 내용은
+ * 그대로 남는다. 옛 config_t는 그것을 쥐고 있던 마지막 쓰레드가 놓을 때 해제된다.
+ *
+ * 설정 파일은 한 줄에 "key value" (또는 "key = value")이고 '#' 뒤는 주석이다.
+ * 명령줄 옵션이 기본값이고 파일 값이 그것을 덮어쓴다. pool이나 route 줄이 하나라도 있으면
+ * 명령줄의 pool과 route는 모두 파일의 것으로 바뀐다. 잘못된 줄이 하나라도 있으면 파일 전체를
+ * 적용하지 않고 이전 설정을 계속 쓴다.
+ *
+ *   key              옵션  값
+ *   connect_ms       -C    end server connect deadline (ms, 0이면 커널 기본값)
+ *   first_byte_ms    -F    첫 응답 바이트 deadline (ms, 0이면 없음)
+ *   idle_ms          -I    응답 중 idle deadline (ms, 0이면 없음)
+ *   header_ms        -E    client의 request line과 header를 기다리는 deadline (ms, 0이면 없음)
+ *   drain_ms         -D    SIGTERM이나 넘겨주기 뒤 남은 요청을 기다리는 시간 (ms, drain.h)
+ *   mem_budget       -M    중계/캐시 버퍼 메모리 합의 상한 (bytes, budget.h)
+ *   cache_size             캐시 객체가 쓰는 slab 메모리 상한 (bytes, CACHE_SIZE_LIMIT 이하)
+ *   max_object_size        캐시할 응답 크기 상한 (bytes, MAX_OBJECT_SIZE 이하)
+ *   admission        -A    lru | tinylfu
+ *   range_fill       -R    0 | 1
+ *   negative         -N    negcache.h의 TTL spec. 준 항목만 바꾼다
+ *   log_level        -l    error | warn | info | debug
+ *   pool             -P    name=host:port,... (여러 줄)
+ *   route            -r    [host][/prefix]=name (여러 줄)
+ *   balance          -L    least | p2c
+ *
+ * worker 수, 대기열, 중계 backend, 연결 예산, snapshot, prefetch, cache key 규칙은 시작할 때만 정한다.
+ */
+#ifndef __CONFIG_H__
+#define __CONFIG_H__
+
+#include "csapp.h"
+#include "negcache.h"
+#include "pool.h"
+
+#define DEFAULT_CONNECT_MS 3000
+#define DEFAULT_HEADER_MS 10000 /* 연결만 하고 요청을 보내지 않는 client가 worker를 쥐는 시간 */
+
+typedef struct config
+{
+  long generation; /* 1부터. 다시 읽을 때마다 1씩 */
+  int refcnt;      /* atomic: 이 설정을 쥔 쓰레드 수 (+ 현재 설정이면 1) */
+  int connect_ms, first_byte_ms, idle_ms;
+  int header_ms;
+  int drain_ms;
+  long mem_budget;
+  long cache_size;
+  long max_object;
+  int tinylfu;
+  int range_fill;
+  int log_level;
+  neg_ttl_t neg;
+  pool_table_t *pools;
+} config_t;
+
+/* 기본값으로 채운 새 설정 */
+config_t *config_new(void);
+
+/* key(위의 표)를 value로 바꾼다. 모르는 key이거나 값이 틀리면 -1 */
+int config_set(config_t *c, const char *key, const char *value);
+
+/* base(명령줄로 채운 설정)에 path를 덮어쓴 설정을 현재 설정으로 둔다. path가 NULL이면 base만.
+   path가 있으면 SIGHUP을 막으므로 쓰레드를 만들기 전에 부른다. 파일이 틀리면 stderr에 알리고 -1 */
+int config_init(config_t *base, const char *path);
+
+/* path가 있으면 SIGHUP마다 설정을 다시 읽는 쓰레드를 띄운다 */
+void config_start(void);
+
+/* 설정 파일을 지금 다시 읽는다 (SIGHUP과 같다). 틀리면 지금 설정을 그대로 둔다.
+   master가 다시 띄운 worker(proxy -m)가 fork로 물려받은 처음 설정을 버릴 때 */
+void config_reload(void);
+
+/* 이 쓰레드가 보고 있는 설정. 처음 부를 때 현재 설정을 잡는다 */
+config_t *config_get(void);
+
+/* 설정이 바뀌었으면 이 쓰레드를 새 설정으로 옮기고 이전 것을 놓는다.
+   요청 사이처럼 이전 설정에서 얻은 포인터(backend_t 등)를 더 쓰지 않는 곳에서만 부른다 */
+void config_refresh(void);
+
+/* 현재 설정을 c로 바꾼다. c의 소유권은 넘어간다 (cachesim처럼 파일 없이 바꿀 때) */
+void config_install(config_t *c);
+
+/* 현재 설정을 out에 쓴다 (stats_serve) */
+void config_report(FILE *out, int json);
+
+#endif /* __CONFIG_H__ */
@@ -907,8 +907,14 @@ ssize_t Rio_readn(int fd, void *ptr, size_t nbytes)
 
 void Rio_writen(int fd, void *usrbuf, size_t n) 
 {
-    if (rio_writen(fd, usrbuf, n) != n)
+    if (rio_writen(fd, usrbuf, n) != n) {
+	/* A peer that went away must not take the whole (threaded) proxy down */
+	if (errno == EPIPE || errno == ECONNRESET) {
+	    fprintf(stderr, "Rio_writen error: %s\n", strerror(errno));
+	    return;
+	}
 	unix_error("Rio_writen error");
+    }
 }
 
 void Rio_readinitb(rio_t *rp, int fd)
@@ -929,8 +935,13 @@ ssize_t Rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen)
 {
     ssize_t rc;
 
-    if ((rc = rio_readlineb(rp, usrbuf, maxlen)) < 0)
+    if ((rc = rio_readlineb(rp, usrbuf, maxlen)) < 0) {
+	if (errno == ECONNRESET) {
+	    fprintf(stderr, "Rio_readlineb error: %s\n", strerror(errno));
+	    return 0;
+	}
 	unix_error("Rio_readlineb error");
+    }
     return rc;
 } 
 
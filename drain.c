@@ -0,0 +1,255 @@
+/*
+ * drain.c - SIGTERM drain, idle 연결 닫기, Unix socket으로 listen socket 넘겨주기
+ */
+#include "csapp.h"
+#include <sys/un.h>
+#include "drain.h"
+#include "admit.h"
+#include "relay.h"
+#include "snapshot.h"
+#include "config.h"
+#include "hist.h"
+#include "log.h"
+
+#define HANDOVER_REQ 'T' /* 새 process가 보내는 요청 바이트 */
+#define IDLE_BUSY (-2)   /* drain이 그 연결을 shutdown하는 중 */
+
+typedef struct
+{
+  int fd;          /* atomic: request line을 기다리는 연결. 없으면 -1 */
+  long long since; /* 기다리기 시작한 시각 (hist_now) */
+} __attribute__((aligned(64))) idle_t;
+
+static idle_t idle[DRAIN_SLOTS];
+static int nidle;                /* atomic: 배정한 slot 수 */
+static __thread idle_t *my_idle; /* 이 worker의 slot */
+static __thread int my_assigned;
+
+static sigset_t term_set;
+static int listen_fd, unix_fd = -1;
+static int draining;       /* atomic: drain을 시작한 쓰레드가 1로 바꾼다 */
+static int accept_stopped; /* atomic: main이 accept 루프를 빠져나왔다 */
+
+void drain_init(void)
+{
+  int i;
+
+  for (i = 0; i < DRAIN_SLOTS; i++)
+    idle[i].fd = -1;
+  sigemptyset(&term_set);
+  sigaddset(&term_set, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &term_set, NULL);
+}
+
+void drain_idle_begin(int fd)
+{
+  int n;
+
+  if (!my_assigned)
+  {
+    my_assigned = 1;
+    if ((n = __atomic_fetch_add(&nidle, 1, __ATOMIC_RELAXED)) < DRAIN_SLOTS)
+      my_idle = &idle[n];
+  }
+  if (my_idle == NULL)
+    return;
+  __atomic_store_n(&my_idle->since, hist_now(), __ATOMIC_RELAXED);
+  __atomic_store_n(&my_idle->fd, fd, __ATOMIC_RELEASE);
+}
+
+void drain_idle_end(int fd)
+{
+  int expect = fd;
+
+  if (my_idle == NULL)
+    return;
+  /* drain이 shutdown하는 중이면 끝날 때까지 기다린다. 그 전에 close하면 같은 번호를 받은
+     다른 연결이 닫힐 수 있다 */
+  while (!__atomic_compare_exchange_n(&my_idle->fd, &expect, -1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+  {
+    if (expect == -1)
+      break;
+    expect = fd;
+    sched_yield();
+  }
+}
+
+/* before보다 먼저부터 request line을 기다리던 연결을 닫는다. worker의 읽기는 EOF로 끝난다 */
+static void close_idle(long long before)
+{
+  int i, fd, n = __atomic_load_n(&nidle, __ATOMIC_RELAXED);
+
+  for (i = 0; i < n && i < DRAIN_SLOTS; i++)
+  {
+    fd = __atomic_load_n(&idle[i].fd, __ATOMIC_ACQUIRE);
+    if (fd < 0 || __atomic_load_n(&idle[i].since, __ATOMIC_RELAXED) > before)
+      continue;
+    if (!__atomic_compare_exchange_n(&idle[i].fd, &fd, IDLE_BUSY, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+      continue;
+    shutdown(fd, SHUT_RDWR);
+    __atomic_store_n(&idle[i].fd, -1, __ATOMIC_RELEASE);
+  }
+}
+
+void drain_accept_stopped(void)
+{
+  __atomic_store_n(&accept_stopped, 1, __ATOMIC_RELEASE);
+}
+
+/* accept를 멈추고, 남은 연결이 끝나거나 drain_ms가 지나면 process를 끝낸다 */
+static void run(const char *reason)
+{
+  long long start = hist_now(), deadline = start + config_get()->drain_ms * 1000000LL;
+  int n, saved = -1;
+
+  LOGF(LOG_INFO, "%s: draining %ld connections", reason, (long)admit_pending());
+  relay_accept_stop();
+  /* main이 이미 받은 연결을 대기열에 넣을 때까지 */
+  while (!__atomic_load_n(&accept_stopped, __ATOMIC_ACQUIRE) && hist_now() < deadline)
+    usleep(DRAIN_POLL_MS * 1000);
+  while ((n = admit_pending()) > 0 && hist_now() < deadline)
+  {
+    close_idle(hist_now() - DRAIN_IDLE_MS * 1000000LL);
+    usleep(DRAIN_POLL_MS * 1000);
+  }
+  if (snapshot_enabled())
+    saved = snapshot_save();
+  /* 로그 쓰레드를 기다리지 않고 바로 남긴다 */
+  if (saved >= 0)
+    printf("snapshot: saved %d objects\n", saved);
+  printf("drain: %d connections left after %lld ms, exiting\n", n, (hist_now() - start) / 1000000);
+  exit(0);
+}
+
+static void *term_thread(void *vargp)
+{
+  Pthread_detach(pthread_self());
+  while (sigwaitinfo(&term_set, NULL) != SIGTERM)
+    ;
+  /* 넘겨주는 중이면 그쪽이 drain한다 */
+  if (!__atomic_exchange_n(&draining, 1, __ATOMIC_ACQ_REL))
+    run("SIGTERM");
+  return NULL;
+}
+
+static int send_fd(int sock, int fd)
+{
+  char c = HANDOVER_REQ;
+  struct iovec iov = {&c, 1};
+  struct msghdr msg;
+  struct cmsghdr *cm;
+  union
+  {
+    struct cmsghdr h;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } ctl;
+
+  memset(&msg, 0, sizeof(msg));
+  memset(&ctl, 0, sizeof(ctl));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctl.buf;
+  msg.msg_controllen = sizeof(ctl.buf);
+  cm = CMSG_FIRSTHDR(&msg);
+  cm->cmsg_level = SOL_SOCKET;
+  cm->cmsg_type = SCM_RIGHTS;
+  cm->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cm), &fd, sizeof(int));
+  return sendmsg(sock, &msg, MSG_NOSIGNAL) == 1 ? 0 : -1;
+}
+
+static void *handover_thread(void *vargp)
+{
+  int fd, n;
+  char c;
+
+  Pthread_detach(pthread_self());
+  while (1)
+  {
+    if ((fd = accept(unix_fd, NULL, NULL)) < 0)
+      continue;
+    if (read(fd, &c, 1) != 1 || c != HANDOVER_REQ || __atomic_exchange_n(&draining, 1, __ATOMIC_ACQ_REL))
+    {
+      close(fd);
+      continue;
+    }
+    /* 새 process는 listen socket을 받은 뒤 snapshot을 읽으므로 보내기 전에 저장한다 */
+    n = snapshot_enabled() ? snapshot_save() : 0;
+    if (send_fd(fd, listen_fd) < 0)
+    {
+      LOGF(LOG_WARN, "handover: cannot send listening socket: %s", strerror(errno));
+      __atomic_store_n(&draining, 0, __ATOMIC_RELEASE);
+      close(fd);
+      continue;
+    }
+    /* 이제 snapshot 파일은 새 process 것이다 */
+    snapshot_disable();
+    close(fd);
+    close(unix_fd);
+    LOGF(LOG_INFO, "handover: listening socket sent, %ld cached objects saved", NULL, (long)n);
+    run("handover");
+  }
+  return NULL;
+}
+
+int drain_takeover(const char *path)
+{
+  struct sockaddr_un sa;
+  char c = HANDOVER_REQ;
+  struct iovec iov = {&c, 1};
+  struct msghdr msg;
+  struct cmsghdr *cm;
+  union
+  {
+    struct cmsghdr h;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } ctl;
+  int fd, listenfd = -1;
+
+  if (path == NULL || strlen(path) >= sizeof(sa.sun_path))
+    return -1;
+  memset(&sa, 0, sizeof(sa));
+  sa.sun_family = AF_UNIX;
+  strcpy(sa.sun_path, path);
+  if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+    return -1;
+  if (connect(fd, (SA *)&sa, sizeof(sa)) < 0 || write(fd, &c, 1) != 1)
+  {
+    close(fd);
+    return -1;
+  }
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctl.buf;
+  msg.msg_controllen = sizeof(ctl.buf);
+  /* 기존 process가 snapshot을 저장하는 동안 기다린다. drain 중이면 그냥 닫힌다 */
+  if (recvmsg(fd, &msg, 0) == 1 && (cm = CMSG_FIRSTHDR(&msg)) != NULL &&
+      cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS)
+    memcpy(&listenfd, CMSG_DATA(cm), sizeof(int));
+  close(fd);
+  return listenfd;
+}
+
+void drain_start(int listenfd, const char *path)
+{
+  struct sockaddr_un sa;
+  pthread_t tid;
+
+  listen_fd = listenfd;
+  Pthread_create(&tid, NULL, term_thread, NULL);
+  if (path == NULL)
+    return;
+  /* 이전 process가 남긴 socket 파일이 있으면 지운다 (넘겨받았으면 이미 다 쓴 것) */
+  memset(&sa, 0, sizeof(sa));
+  sa.sun_family = AF_UNIX;
+  strncpy(sa.sun_path, path, sizeof(sa.sun_path) - 1);
+  unlink(path);
+  if ((unix_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0 ||
+      bind(unix_fd, (SA *)&sa, sizeof(sa)) < 0 || listen(unix_fd, 1) < 0)
+  {
+    LOGF(LOG_WARN, "handover: cannot listen on %s (errno %ld)", path, (long)errno);
+    return;
+  }
+  Pthread_create(&tid, NULL, handover_thread, NULL);
+}
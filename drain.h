@@ -0,0 +1,42 @@
+/*
+ * drain.h - graceful drain과 listen socket 넘겨주기 (무중단 binary 교체)
+ *
+ * drain: SIGTERM을 받으면 새 연결을 더 받지 않고, 이미 받은 연결(대기열 포함)은 끝까지 처리한
+ * 뒤 종료한다. 설정의 drain_ms(-D)가 지나면 남은 연결이 있어도 끝낸다. request line을 보내지 않은
+ * 채 DRAIN_IDLE_MS 넘게 붙어 있는 연결은 기다리지 않고 닫는다. snapshot(-S)을 쓰면 끝나기 직전에
+ * 저장한다.
+ *
+ * 넘겨주기: -u path를 주면 그 경로에 Unix socket을 열어 둔다. 같은 -u로 새 binary를 실행하면
+ * 새 process는 port를 다시 bind하지 않고 기존 process에게서 listen socket을 받아 온다 (SCM_RIGHTS).
+ * 기존 process는 snapshot이 있으면 먼저 저장해 새 process가 그것으로 캐시를 채우게 하고,
+ * socket을 보낸 뒤 drain한다. 두 process가 같은 listen socket을 쥐고 있는 동안 도착한 연결은
+ * backlog에서 어느 한쪽이 받으므로, 교체하는 동안 거절되는 연결이 없다.
+ */
+#ifndef __DRAIN_H__
+#define __DRAIN_H__
+
+#include "csapp.h"
+
+#define DEFAULT_DRAIN_MS 30000 /* 남은 요청을 기다리는 시간 */
+#define DRAIN_IDLE_MS 1000     /* drain 중 request line 없이 이만큼 붙어 있으면 닫는다 */
+#define DRAIN_POLL_MS 10       /* 남은 연결 수를 확인하는 간격 */
+#define DRAIN_SLOTS 1024       /* idle 연결을 추적하는 worker 수 (넘는 worker는 추적하지 않음) */
+
+/* 다른 쓰레드를 만들기 전에 부른다: SIGTERM을 drain 쓰레드만 받도록 막아 둔다 */
+void drain_init(void);
+
+/* path의 Unix socket으로 실행 중인 proxy에게서 listen socket을 받아 온다.
+   path가 NULL이거나 받을 process가 없으면 -1 (호출한 쪽이 직접 bind한다) */
+int drain_takeover(const char *path);
+
+/* SIGTERM을 기다리는 쓰레드와, path가 있으면 넘겨주기 요청을 받는 쓰레드를 띄운다 */
+void drain_start(int listenfd, const char *path);
+
+/* main: accept 루프를 빠져나왔다. 이후로 새 연결은 생기지 않는다 */
+void drain_accept_stopped(void);
+
+/* worker: fd에서 request line을 기다리기 시작/끝. 그 사이에만 drain이 연결을 닫을 수 있다 */
+void drain_idle_begin(int fd);
+void drain_idle_end(int fd);
+
+#endif /* __DRAIN_H__ */
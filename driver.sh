@@ -8,6 +8,16 @@
 #     updated: 2/8/2016
 # 
 #     usage: ./driver.sh
+#            ./driver.sh perf [baseline]
+#
+#     perf mode runs a fixed matrix of workloads with ./loadgen instead
+#     of the correctness tests, writes one line per workload to
+#     .perf/results.tsv and compares it against perf-baseline.tsv. It
+#     exits non-zero if a workload had errors, or if its req/s dropped
+#     or its p99 latency rose by more than PERF_THRESHOLD percent.
+#     "perf baseline" stores the new results as the baseline instead.
+#     Baselines are machine-specific, so record one on the machine you
+#     compare on.
 # 
 
 # Point values
@@ -40,6 +50,22 @@ CACHE_LIST="tiny.c
 # The file we will fetch for various tests
 FETCH_FILE="home.html"
 
+# Perf mode settings (PERF_SECONDS, PERF_THRESHOLD and PERF_MIN_US can
+# be overridden from the environment)
+PERF_DIR="./.perf"
+PERF_RESULTS="${PERF_DIR}/results.tsv"
+PERF_BASELINE="./perf-baseline.tsv"
+PERF_SECONDS=${PERF_SECONDS:-5}
+PERF_THRESHOLD=${PERF_THRESHOLD:-25}
+PERF_MIN_US=${PERF_MIN_US:-1000}  # p99 changes smaller than this are noise
+SLOW_DELAY_MS=50
+
+# Files fetched over and over by the cache workloads
+PERF_LIST="home.html
+           csapp.c
+           tiny.c
+           godzilla.jpg"
+
 #####
 # Helper functions
 #
@@ -132,6 +158,170 @@ function free_port {
 }
 
 
+#
+# json_field - print a numeric field of the JSON line read from stdin
+# usage: json_field <name>
+#
+function json_field {
+    grep -o "\"$1\": [0-9.]*" | head -1 | cut -d' ' -f2
+}
+
+#
+# start_perf_servers - start tiny, the slow origin, a caching proxy and
+#     a proxy that caches nothing, each on a port from free-port.sh
+#
+function start_perf_servers {
+    tiny_port=`./free-port.sh`
+    echo "Starting tiny on port ${tiny_port}"
+    cd ./tiny
+    ./tiny ${tiny_port} &> /dev/null &
+    tiny_pid=$!
+    cd ${HOME_DIR}
+    wait_for_port_use "${tiny_port}"
+
+    slow_port=`./free-port.sh`
+    echo "Starting the slow origin (${SLOW_DELAY_MS} ms) on port ${slow_port}"
+    ./slow-server.py ${slow_port} ${SLOW_DELAY_MS} &> /dev/null &
+    slow_pid=$!
+    wait_for_port_use "${slow_port}"
+
+    proxy_port=`./free-port.sh`
+    echo "Starting the caching proxy on port ${proxy_port}"
+    ./proxy ${proxy_port} &> /dev/null &
+    proxy_pid=$!
+    wait_for_port_use "${proxy_port}"
+
+    # Nothing fits in a 1-byte object limit, so every request goes to
+    # the origin
+    echo "max_object_size 1" > ${PERF_DIR}/nocache.conf
+    nocache_port=`./free-port.sh`
+    echo "Starting the non-caching proxy on port ${nocache_port}"
+    ./proxy -f ${PERF_DIR}/nocache.conf ${nocache_port} &> /dev/null &
+    nocache_pid=$!
+    wait_for_port_use "${nocache_port}"
+}
+
+#
+# run_workload - run ./loadgen for PERF_SECONDS and append its results
+#     to PERF_RESULTS
+# usage: run_workload <name> <loadgen args...>
+#
+function run_workload {
+    name=$1
+    shift
+    echo "${name}: ./loadgen $*"
+    ./loadgen -j -d ${PERF_SECONDS} "$@" > ${PERF_DIR}/${name}.json
+    result=`cat ${PERF_DIR}/${name}.json`
+    rps=`echo "${result}" | json_field req_per_sec`
+    bps=`echo "${result}" | json_field bytes_per_sec`
+    p50=`echo "${result}" | json_field p50`
+    p99=`echo "${result}" | json_field p99`
+    errors=`echo "${result}" | json_field errors`
+    non2xx=`echo "${result}" | json_field non2xx`
+    errors=`expr ${errors:-1} + ${non2xx:-0}`
+    echo "   ${rps} req/s, ${bps} bytes/s, p50 ${p50} us, p99 ${p99} us, ${errors} errors"
+    printf "%s\t%s\t%s\t%s\t%s\t%s\n" ${name} ${rps} ${bps} ${p50} ${p99} ${errors} >> ${PERF_RESULTS}
+}
+
+#
+# compare_baseline - compare PERF_RESULTS against PERF_BASELINE. Returns
+#     non-zero if any workload had errors or regressed beyond
+#     PERF_THRESHOLD percent
+#
+function compare_baseline {
+    awk -F'\t' -v th=${PERF_THRESHOLD} -v min_us=${PERF_MIN_US} '
+        /^#/ { next }
+        NR == FNR { rps[$1] = $2; p99[$1] = $5; next }
+        {
+            status = "ok"
+            if ($6 > 0) {
+                status = "FAIL: " $6 " errors"
+            } else if (!($1 in rps)) {
+                status = "no baseline"
+            } else if ($2 < rps[$1] * (1 - th / 100)) {
+                status = sprintf("FAIL: req/s %.1f < baseline %.1f", $2, rps[$1])
+            } else if ($5 > p99[$1] * (1 + th / 100) && $5 - p99[$1] > min_us) {
+                status = sprintf("FAIL: p99 %.1f us > baseline %.1f us", $5, p99[$1])
+            }
+            if (status ~ /^FAIL/)
+                fail = 1
+            if ($1 in rps) {
+                d_rps = rps[$1] > 0 ? ($2 / rps[$1] - 1) * 100 : 0
+                d_p99 = p99[$1] > 0 ? ($5 / p99[$1] - 1) * 100 : 0
+                printf "%-14s req/s %+6.1f%%  p99 %+6.1f%%  %s\n", $1, d_rps, d_p99, status
+            } else
+                printf "%-14s %s\n", $1, status
+        }
+        END { exit fail }' ${PERF_BASELINE} ${PERF_RESULTS}
+}
+
+#
+# run_perf - the perf mode. Runs the workload matrix and then either
+#     stores the results as the baseline or compares against it
+# usage: run_perf [baseline]
+#
+function run_perf {
+    echo "*** Perf ***"
+    if [ ! -x ./loadgen ]
+    then
+        echo "Error: ./loadgen not found or not an executable file. Please run make and try again."
+        exit 1
+    fi
+    if [ ! -d ${PERF_DIR} ]
+    then
+        mkdir ${PERF_DIR}
+    fi
+    start_perf_servers
+
+    echo "# workload	req_per_sec	bytes_per_sec	p50_us	p99_us	errors" > ${PERF_RESULTS}
+    urls=""
+    for file in ${PERF_LIST}
+    do
+        urls="${urls} http://localhost:${tiny_port}/${file}"
+    done
+
+    # Warm the caching proxy so that cache_hot measures hits only
+    ./loadgen -c 1 -n 4 -p localhost:${proxy_port} ${urls} > /dev/null
+
+    run_workload small_html -c 16 -p localhost:${nocache_port} http://localhost:${tiny_port}/home.html
+    run_workload large_binary -c 4 -p localhost:${nocache_port} http://localhost:${tiny_port}/puppy.mp4
+    run_workload cache_hot -c 16 -p localhost:${proxy_port} ${urls}
+    run_workload cache_cold -c 16 -p localhost:${nocache_port} ${urls}
+    run_workload cache_hot_rate -c 64 -r 2000 -p localhost:${proxy_port} ${urls}
+    run_workload slow_origin -c 32 -p localhost:${nocache_port} http://localhost:${slow_port}/slow.html
+
+    echo "Killing tiny, the slow origin, and the proxies"
+    for pid in ${tiny_pid} ${slow_pid} ${proxy_pid} ${nocache_pid}
+    do
+        kill ${pid} 2> /dev/null
+        wait ${pid} 2> /dev/null
+    done
+
+    echo ""
+    echo "Results written to ${PERF_RESULTS}"
+    if [ "$1" == "baseline" ]
+    then
+        cp ${PERF_RESULTS} ${PERF_BASELINE}
+        echo "Stored as the new baseline ${PERF_BASELINE}"
+        exit 0
+    fi
+    if [ ! -f ${PERF_BASELINE} ]
+    then
+        echo "No baseline ${PERF_BASELINE}; run ./driver.sh perf baseline to record one"
+        awk -F'\t' '!/^#/ && $6 > 0 { print $1 ": " $6 " errors"; fail = 1 } END { exit fail }' ${PERF_RESULTS}
+        exit $?
+    fi
+    echo "Comparing against ${PERF_BASELINE} (threshold ${PERF_THRESHOLD}%)"
+    compare_baseline
+    if [ $? -ne 0 ]
+    then
+        echo "perfResult: FAIL"
+        exit 1
+    fi
+    echo "perfResult: PASS"
+    exit 0
+}
+
 #######
 # Main 
 #######
@@ -142,7 +332,7 @@ function free_port {
 #
 
 # Kill any stray proxies or tiny servers owned by this user
-killall -q proxy tiny nop-server.py 2> /dev/null
+killall -q proxy tiny nop-server.py slow-server.py 2> /dev/null
 
 # Make sure we have a Tiny directory
 if [ ! -d ./tiny ]
@@ -202,6 +392,11 @@ fi
 # Add a handler to generate a meaningful timeout message
 trap 'echo "Timeout waiting for the server to grab the port reserved for it"; kill $$' ALRM
 
+if [ "$1" == "perf" ]
+then
+    run_perf $2
+fi
+
 #####
 # Basic
 #
@@ -0,0 +1,111 @@
+/*
+ * hist.c - 쓰레드별 로그 버킷 지연 시간 히스토그램
+ */
+#include "csapp.h"
+#include "hist.h"
+
+#define HIST_SHARDS 32
+
+typedef struct
+{
+  unsigned long long b[PHASE_NR][HIST_BUCKETS];
+} __attribute__((aligned(64))) hist_shard_t;
+
+static const char *phase_names[PHASE_NR] = {
+    "accept_wait",
+    "parse",
+    "cache_lookup",
+    "dns",
+    "connect",
+    "first_byte",
+    "transfer",
+    "total",
+};
+
+static const struct
+{
+  const char *name;
+  double q;
+} quantiles[] = {{"p50", 0.5}, {"p90", 0.9}, {"p99", 0.99}, {"p999", 0.999}};
+
+static hist_shard_t shards[HIST_SHARDS];
+static int next_shard;
+static __thread hist_shard_t *my_shard;
+
+int hist_bucket(long long ns)
+{
+  unsigned long long v = ns < 0 ? 0 : ns;
+  int msb, shift;
+
+  if (v < HIST_SUB)
+    return v;
+  msb = 63 - __builtin_clzll(v);
+  if (msb >= HIST_MAX_BITS)
+    return HIST_BUCKETS - 1;
+  shift = msb - HIST_SUB_BITS;
+  return (shift + 1) * HIST_SUB + ((v >> shift) & (HIST_SUB - 1));
+}
+
+long long hist_bucket_value(int idx)
+{
+  int shift;
+
+  if (idx < HIST_SUB)
+    return idx;
+  shift = idx / HIST_SUB - 1;
+  return ((long long)(HIST_SUB + idx % HIST_SUB) << shift) + ((1LL << shift) >> 1);
+}
+
+long long hist_quantile(const unsigned long long *b, unsigned long long count, double q)
+{
+  /* 누적 개수가 처음으로 rank 이상이 되는 버킷 */
+  unsigned long long rank = (unsigned long long)(q * count + 0.999999), seen = 0;
+  int i;
+
+  for (i = 0; count && i < HIST_BUCKETS; i++)
+    if ((seen += b[i]) >= rank)
+      return hist_bucket_value(i);
+  return 0;
+}
+
+void hist_record(phase_t phase, long long ns)
+{
+  if (my_shard == NULL)
+    my_shard = &shards[__atomic_fetch_add(&next_shard, 1, __ATOMIC_RELAXED) % HIST_SHARDS];
+  __atomic_fetch_add(&my_shard->b[phase][hist_bucket(ns)], 1, __ATOMIC_RELAXED);
+}
+
+void hist_report(FILE *out, int json)
+{
+  unsigned long long merged[HIST_BUCKETS], count;
+  int p, q, i;
+  long long v;
+
+  for (p = 0; p < PHASE_NR; p++)
+  {
+    count = 0;
+    for (i = 0; i < HIST_BUCKETS; i++)
+    {
+      merged[i] = 0;
+      for (q = 0; q < HIST_SHARDS; q++)
+        merged[i] += __atomic_load_n(&shards[q].b[p][i], __ATOMIC_RELAXED);
+      count += merged[i];
+    }
+
+    if (json)
+      fprintf(out, "%s\"%s\": {\"count\": %llu", p ? ", " : "", phase_names[p], count);
+    else
+      fprintf(out, "latency_%s_count %llu\n", phase_names[p], count);
+
+    for (q = 0; q < (int)(sizeof(quantiles) / sizeof(quantiles[0])); q++)
+    {
+      v = hist_quantile(merged, count, quantiles[q].q);
+      if (json)
+        fprintf(out, ", \"%s\": %lld", quantiles[q].name, v);
+      else
+        fprintf(out, "latency_%s_%s_ns %lld\n", phase_names[p], quantiles[q].name, v);
+    }
+    if (json)
+      fprintf(out, "}");
+  }
+}
@@ -0,0 +1,53 @@
+/*
+ * hist.h - 요청 처리 단계별 지연 시간 히스토그램
+ *
+ * HDR 히스토그램처럼 값(ns)을 2의 거듭제곱 구간마다 HIST_SUB개의 하위 구간으로 나눠 센다.
+ * 상대 오차는 1/HIST_SUB(약 6%) 이내이고, 기록은 버킷 하나에 relaxed atomic add 한 번이다.
+ * 쓰레드마다 shard를 따로 두고, 보고할 때만 모두 합쳐 백분위수를 계산한다.
+ */
+#ifndef __HIST_H__
+#define __HIST_H__
+
+#include "csapp.h"
+#include <time.h>
+
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS 36 /* 2^36 ns(약 68초) 이상은 마지막 버킷에 모은다 */
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef enum
+{
+  PHASE_ACCEPT_WAIT,  /* accept()부터 worker가 대기열에서 꺼낼 때까지 */
+  PHASE_PARSE,        /* request line과 header를 읽고 end server용 header를 만들 때까지 */
+  PHASE_CACHE_LOOKUP,
+  PHASE_DNS,          /* getaddrinfo() */
+  PHASE_CONNECT,      /* end server와 connect() */
+  PHASE_FIRST_BYTE,   /* request 전송부터 응답 첫 바이트까지 */
+  PHASE_TRANSFER,     /* 응답 첫 바이트부터 EOF까지 */
+  PHASE_TOTAL,        /* doit() 전체 */
+  PHASE_NR
+} phase_t;
+
+/* monotonic clock, ns 단위 */
+static inline long long hist_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void hist_record(phase_t phase, long long ns);
+
+/* ns 값이 들어갈 버킷 번호와, 버킷이 나타내는 구간의 중간값 (loadgen처럼 따로 세는 쪽에서도 쓴다) */
+int hist_bucket(long long ns);
+long long hist_bucket_value(int idx);
+
+/* 버킷 배열 b(합 count)의 q 분위수 (ns). 비어 있으면 0 */
+long long hist_quantile(const unsigned long long *b, unsigned long long count, double q);
+
+/* 모든 shard를 합쳐 단계별 p50/p90/p99/p999를 out에 쓴다 */
+void hist_report(FILE *out, int json);
+
+#endif /* __HIST_H__ */
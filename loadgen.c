@@ -0,0 +1,377 @@
+/*
+ * loadgen.c - epoll 기반 HTTP 부하 생성기 (처리량과 지연 분포 측정)
+ *
+ * usage: ./loadgen [-c conns] [-d seconds] [-n requests] [-r rate] [-p host:port] [-T ms] [-j] url...
+ *
+ * 연결 conns개를 epoll 하나로 동시에 돌린다. proxy와 tiny가 응답 뒤 연결을 닫으므로 요청마다
+ * 새로 connect하고 "Connection: close"로 보낸 뒤 EOF까지 읽는다. url이 여러 개면 돌아가며 쓴다.
+ *
+ *   closed-loop (기본): 연결마다 응답을 다 받으면 바로 다음 요청을 보낸다
+ *   open-loop (-r rate): 초당 rate개를 정해진 시각에 보낸다. 빈 연결이 없으면 요청은 밀리고,
+ *                       지연은 보냈어야 할 시각부터 잰다 (coordinated omission 보정).
+ *                       보낸 시각부터 잰 값은 service 지연으로 따로 보고한다
+ *
+ * -p를 주면 그 proxy에 connect해서 absolute URI로, 없으면 url의 서버에 origin-form으로 보낸다.
+ * -d 동안(기본 10초) 또는 요청 -n개를 마칠 때까지 돌리고, 요청/s, bytes/s와 p50..p99.9를
+ * 출력한다. -j면 한 줄 JSON으로 출력한다 (driver.sh의 perf mode가 읽는다).
+ */
+#include "csapp.h"
+#include <sys/epoll.h>
+#include "hist.h"
+
+#define MAX_TARGETS 64
+#define MAX_CONNS 4096
+#define DEFAULT_CONNS 16
+#define DEFAULT_SECONDS 10
+#define DEFAULT_TIMEOUT_MS 10000
+
+typedef struct
+{
+  char url[MAXLINE];
+  char req[MAXLINE]; /* 보낼 요청 전체 */
+  int len;
+  struct sockaddr_storage addr;
+  socklen_t addrlen;
+} target_t;
+
+typedef struct
+{
+  int fd;                      /* 쉬는 연결이면 -1 */
+  int sent;                    /* 요청을 보낸 바이트 수 */
+  target_t *t;
+  long long intended, started; /* 보냈어야 할 시각과 connect를 시작한 시각 (ns) */
+  long bytes;
+  char head[16];               /* 응답 status line 앞부분 */
+  int hlen;
+} conn_t;
+
+static target_t targets[MAX_TARGETS];
+static int ntargets, next_target;
+static conn_t conns[MAX_CONNS];
+static int nconns = DEFAULT_CONNS, epfd;
+
+/* 결과 */
+static unsigned long long lat[HIST_BUCKETS], service[HIST_BUCKETS];
+static long done, errors, non2xx, timeouts, late;
+static long long total_bytes, max_lat;
+
+static void usage(char *prog)
+{
+  fprintf(stderr, "usage: %s [-c conns] [-d seconds] [-n requests] [-r rate] [-p host:port] [-T ms] [-j] url...\n", prog);
+  exit(1);
+}
+
+static int resolve(char *host, char *port, struct sockaddr_storage *addr, socklen_t *addrlen)
+{
+  struct addrinfo hints, *res;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host, port, &hints, &res) != 0)
+    return -1;
+  memcpy(addr, res->ai_addr, res->ai_addrlen);
+  *addrlen = res->ai_addrlen;
+  freeaddrinfo(res);
+  return 0;
+}
+
+/* "http://host[:port]/path"를 나눈다. 틀리면 -1 */
+static int split_url(char *url, char *host, char *port, char *path)
+{
+  char *p, *slash;
+
+  if (strncasecmp(url, "http://", 7))
+    return -1;
+  p = url + 7;
+  slash = p + strcspn(p, "/");
+  strcpy(path, *slash ? slash : "/");
+  snprintf(host, MAXLINE, "%.*s", (int)(slash - p), p);
+  strcpy(port, "80");
+  if ((p = strchr(host, ':')) != NULL)
+  {
+    *p = '\0';
+    strcpy(port, p + 1);
+  }
+  return *host ? 0 : -1;
+}
+
+static int add_target(char *url, char *proxy)
+{
+  target_t *t;
+  char host[MAXLINE], port[MAXLINE], path[MAXLINE], *colon;
+
+  if (ntargets == MAX_TARGETS || strlen(url) >= MAXLINE / 2 || split_url(url, host, port, path) < 0)
+    return -1;
+  t = &targets[ntargets++];
+  strcpy(t->url, url);
+  if (proxy)
+  {
+    t->len = snprintf(t->req, MAXLINE, "GET %s HTTP/1.0\r\nHost: %s:%s\r\nConnection: close\r\n\r\n", url, host, port);
+    strcpy(host, proxy);
+    if ((colon = strrchr(host, ':')) == NULL)
+      return -1;
+    *colon = '\0';
+    strcpy(port, colon + 1);
+  }
+  else
+    t->len = snprintf(t->req, MAXLINE, "GET %s HTTP/1.0\r\nHost: %s:%s\r\nConnection: close\r\n\r\n", path, host, port);
+  return resolve(host, port, &t->addr, &t->addrlen);
+}
+
+static void finish(conn_t *c, int ok, long long now)
+{
+  long long ns = now - c->intended;
+
+  epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+  close(c->fd);
+  c->fd = -1;
+  if (!ok)
+  {
+    errors++;
+    return;
+  }
+  done++;
+  total_bytes += c->bytes;
+  /* "HTTP/1.x 200" */
+  if (c->hlen < 12 || c->head[9] != '2')
+    non2xx++;
+  lat[hist_bucket(ns)]++;
+  service[hist_bucket(now - c->started)]++;
+  if (ns > max_lat)
+    max_lat = ns;
+}
+
+/* 빈 연결 c로 요청 하나를 시작한다. intended는 보냈어야 할 시각 */
+static void start(conn_t *c, long long intended, long long now)
+{
+  struct epoll_event ev;
+  int fd;
+
+  c->t = &targets[next_target++ % ntargets];
+  c->intended = intended;
+  c->started = now;
+  c->sent = 0;
+  c->bytes = 0;
+  c->hlen = 0;
+  if ((fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
+  {
+    errors++;
+    return;
+  }
+  if (connect(fd, (SA *)&c->t->addr, c->t->addrlen) < 0 && errno != EINPROGRESS)
+  {
+    close(fd);
+    errors++;
+    return;
+  }
+  c->fd = fd;
+  ev.events = EPOLLOUT;
+  ev.data.ptr = c;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static void on_event(conn_t *c, long long now)
+{
+  static char buf[65536];
+  struct epoll_event ev;
+  socklen_t len = sizeof(int);
+  int err = 0, n, m;
+
+  if (c->sent < c->t->len)
+  {
+    /* connect가 끝났다. 요청은 작으므로 대개 한 번에 다 나간다 */
+    if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err)
+    {
+      finish(c, 0, now);
+      return;
+    }
+    if ((n = write(c->fd, c->t->req + c->sent, c->t->len - c->sent)) < 0)
+    {
+      if (errno != EAGAIN)
+        finish(c, 0, now);
+      return;
+    }
+    if ((c->sent += n) == c->t->len)
+    {
+      ev.events = EPOLLIN;
+      ev.data.ptr = c;
+      epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+    }
+    return;
+  }
+  while ((n = read(c->fd, buf, sizeof(buf))) > 0)
+  {
+    if (c->hlen < (int)sizeof(c->head))
+    {
+      m = n < (int)sizeof(c->head) - c->hlen ? n : (int)sizeof(c->head) - c->hlen;
+      memcpy(c->head + c->hlen, buf, m);
+      c->hlen += m;
+    }
+    c->bytes += n;
+  }
+  if (n == 0)
+    finish(c, 1, now);
+  else if (errno != EAGAIN)
+    finish(c, 0, now);
+}
+
+static void report(const char *mode, double rate, long long elapsed, char *proxy, int json)
+{
+  double secs = elapsed / 1e9;
+  static const struct
+  {
+    const char *name;
+    double q;
+  } quantiles[] = {{"p50", 0.5}, {"p90", 0.9}, {"p99", 0.99}, {"p999", 0.999}};
+  int i, nq = sizeof(quantiles) / sizeof(quantiles[0]);
+
+  if (json)
+  {
+    printf("{\"mode\": \"%s\", \"rate\": %.0f, \"connections\": %d, \"seconds\": %.3f, \"requests\": %ld, "
+           "\"errors\": %ld, \"timeouts\": %ld, \"non2xx\": %ld, \"late\": %ld, \"req_per_sec\": %.1f, "
+           "\"bytes\": %lld, \"bytes_per_sec\": %.0f, \"latency_us\": {",
+           mode, rate, nconns, secs, done, errors, timeouts, non2xx, late, done / secs,
+           total_bytes, total_bytes / secs);
+    for (i = 0; i < nq; i++)
+      printf("%s\"%s\": %.1f", i ? ", " : "", quantiles[i].name, hist_quantile(lat, done, quantiles[i].q) / 1e3);
+    printf(", \"max\": %.1f}, \"service_us\": {", max_lat / 1e3);
+    for (i = 0; i < nq; i++)
+      printf("%s\"%s\": %.1f", i ? ", " : "", quantiles[i].name, hist_quantile(service, done, quantiles[i].q) / 1e3);
+    printf("}}\n");
+    return;
+  }
+  printf("%s", targets[0].url);
+  if (ntargets > 1)
+    printf(" (+%d urls)", ntargets - 1);
+  if (proxy)
+    printf(" via %s", proxy);
+  printf("\n%s", mode);
+  if (rate > 0)
+    printf(" %.0f req/s", rate);
+  printf(", %d connections, %.2f s\n", nconns, secs);
+  printf("requests %ld (%.1f/s), errors %ld (timeouts %ld), non-2xx %ld\n", done, done / secs, errors, timeouts, non2xx);
+  printf("bytes %lld (%.2f MB/s)\n", total_bytes, total_bytes / secs / 1e6);
+  if (late)
+    printf("behind schedule: %ld requests never sent\n", late);
+  printf("latency (us)  ");
+  for (i = 0; i < nq; i++)
+    printf(" %s %.1f", quantiles[i].name, hist_quantile(lat, done, quantiles[i].q) / 1e3);
+  printf(" max %.1f\n", max_lat / 1e3);
+  /* open-loop에서 둘의 차이가 대기열에서 밀린 시간이다 */
+  if (rate > 0)
+  {
+    printf("service (us)  ");
+    for (i = 0; i < nq; i++)
+      printf(" %s %.1f", quantiles[i].name, hist_quantile(service, done, quantiles[i].q) / 1e3);
+    printf("\n");
+  }
+}
+
+int main(int argc, char **argv)
+{
+  struct epoll_event evs[256];
+  char *proxy = NULL;
+  int opt, i, n, json = 0, timeout_ms = DEFAULT_TIMEOUT_MS, wait_ms;
+  long limit = 0, issued = 0;
+  double seconds = DEFAULT_SECONDS, rate = 0;
+  long long now, begin, end, next_send, interval = 0;
+
+  while ((opt = getopt(argc, argv, "c:d:n:r:p:T:j")) != -1)
+  {
+    switch (opt)
+    {
+    case 'c':
+      nconns = atoi(optarg);
+      break;
+    case 'd':
+      seconds = atof(optarg);
+      break;
+    case 'n':
+      limit = atol(optarg);
+      break;
+    case 'r':
+      rate = atof(optarg);
+      break;
+    case 'p':
+      proxy = optarg;
+      break;
+    case 'T':
+      timeout_ms = atoi(optarg);
+      break;
+    case 'j':
+      json = 1;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind == argc || nconns < 1 || nconns > MAX_CONNS || seconds <= 0 || rate < 0 || timeout_ms <= 0)
+    usage(argv[0]);
+  for (i = optind; i < argc; i++)
+    if (add_target(argv[i], proxy) < 0)
+    {
+      fprintf(stderr, "%s: bad url or cannot resolve: %s\n", argv[0], argv[i]);
+      exit(1);
+    }
+  Signal(SIGPIPE, SIG_IGN);
+  if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    unix_error("epoll_create1 error");
+  for (i = 0; i < nconns; i++)
+    conns[i].fd = -1;
+
+  begin = next_send = hist_now();
+  end = begin + (long long)(seconds * 1e9);
+  if (rate > 0)
+    interval = (long long)(1e9 / rate);
+  while (1)
+  {
+    now = hist_now();
+    /* 새 요청: closed-loop는 빈 연결마다, open-loop는 예정 시각이 지난 것만 */
+    for (i = 0; i < nconns && now < end && (!limit || issued < limit); i++)
+    {
+      if (conns[i].fd >= 0)
+        continue;
+      if (rate > 0)
+      {
+        if (next_send > now)
+          break;
+        start(&conns[i], next_send, now);
+        next_send += interval;
+      }
+      else
+        start(&conns[i], now, now);
+      issued++;
+    }
+    /* 진행 중인 요청이 없고 더 보낼 것도 없으면 끝 */
+    for (i = n = 0; i < nconns; i++)
+      if (conns[i].fd >= 0)
+      {
+        n++;
+        if (now - conns[i].started > timeout_ms * 1000000LL)
+        {
+          timeouts++;
+          finish(&conns[i], 0, now);
+        }
+      }
+    if (n == 0 && (now >= end || (limit && issued >= limit)))
+      break;
+
+    wait_ms = 100;
+    if (rate > 0 && now < end)
+      wait_ms = next_send > now ? (next_send - now) / 1000000 : 0;
+    if (wait_ms > 100)
+      wait_ms = 100;
+    n = epoll_wait(epfd, evs, sizeof(evs) / sizeof(evs[0]), wait_ms);
+    now = hist_now();
+    for (i = 0; i < n; i++)
+      on_event(evs[i].data.ptr, now);
+  }
+  if ((now = hist_now()) > end)
+    now = end;
+  /* open-loop에서 연결이 모자라 끝내 보내지 못한 요청 */
+  if (rate > 0 && next_send < end && (!limit || issued < limit))
+    late = (end - next_send) / interval;
+  report(rate > 0 ? "open-loop" : "closed-loop", rate, now - begin, proxy, json);
+  return 0;
+}
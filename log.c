@@ -0,0 +1,205 @@
+/*
+ * log.c - 쓰레드별 ring buffer + 백그라운드 포맷터로 이루어진 비동기 로그
+ */
+#include "csapp.h"
+#include "log.h"
+#include <time.h>
+
+#define LOG_RINGS 64       /* 동시에 로그를 쓸 수 있는 쓰레드 수 */
+#define LOG_RING_SIZE 128  /* ring 하나의 record 수 (2의 거듭제곱) */
+#define LOG_FLUSH_US 10000 /* 쓸 것이 없을 때 백그라운드 쓰레드가 쉬는 시간 */
+#define LOG_OUTBUF 65536
+
+typedef struct
+{
+  long long ts;    /* CLOCK_REALTIME, ns */
+  const char *fmt; /* 문자열 상수라 포인터만 저장 */
+  int level;
+  long args[LOG_ARGS];
+  char s[LOG_STRLEN];
+} log_rec_t;
+
+/* producer(소유 쓰레드)는 head만, consumer(백그라운드 쓰레드)는 tail만 움직인다 */
+typedef struct
+{
+  unsigned head;
+  char pad[60]; /* head와 tail을 다른 캐시 라인에 */
+  unsigned tail;
+  int owner; /* 쓰레드가 차지하고 있으면 1 */
+  long dropped;
+  log_rec_t recs[LOG_RING_SIZE];
+} __attribute__((aligned(64))) log_ring_t;
+
+volatile int log_level = LOG_INFO;
+
+static const char *level_names[] = {"error", "warn", "info", "debug"};
+
+static log_ring_t rings[LOG_RINGS];
+static long dropped_noring; /* ring을 하나도 얻지 못해 버린 record */
+static pthread_key_t ring_key;
+static __thread log_ring_t *my_ring;
+
+/* 쓰레드가 끝나면 ring을 돌려준다. 남은 record는 백그라운드 쓰레드가 마저 쓴다 */
+static void ring_release(void *vr)
+{
+  log_ring_t *r = vr;
+
+  __atomic_store_n(&r->owner, 0, __ATOMIC_RELEASE);
+}
+
+static log_ring_t *ring_claim(void)
+{
+  int i, zero;
+
+  for (i = 0; i < LOG_RINGS; i++)
+  {
+    zero = 0;
+    if (__atomic_compare_exchange_n(&rings[i].owner, &zero, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    {
+      pthread_setspecific(ring_key, &rings[i]);
+      return my_ring = &rings[i];
+    }
+  }
+  return NULL;
+}
+
+void log_write(log_level_t level, const char *fmt, const char *s, const long *args)
+{
+  log_ring_t *r = my_ring ? my_ring : ring_claim();
+  log_rec_t *rec;
+  struct timespec ts;
+  unsigned head;
+
+  if (r == NULL)
+  {
+    __atomic_fetch_add(&dropped_noring, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  head = r->head;
+  /* 가득 찼으면 기다리지 않고 버린다 */
+  if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= LOG_RING_SIZE)
+  {
+    __atomic_fetch_add(&r->dropped, 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  rec = &r->recs[head & (LOG_RING_SIZE - 1)];
+  clock_gettime(CLOCK_REALTIME, &ts);
+  rec->ts = (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+  rec->fmt = fmt;
+  rec->level = level;
+  memcpy(rec->args, args, sizeof(rec->args));
+  if (s)
+  {
+    strncpy(rec->s, s, LOG_STRLEN - 1);
+    rec->s[LOG_STRLEN - 1] = '\0';
+  }
+  else
+    rec->s[0] = '\0';
+  __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+long log_dropped(void)
+{
+  long total = __atomic_load_n(&dropped_noring, __ATOMIC_RELAXED);
+  int i;
+
+  for (i = 0; i < LOG_RINGS; i++)
+    total += __atomic_load_n(&rings[i].dropped, __ATOMIC_RELAXED);
+  return total;
+}
+
+/* record 하나를 "시:분:초.us 레벨 메시지" 한 줄로 만든다 */
+static int format_rec(char *out, log_rec_t *rec)
+{
+  struct tm tm;
+  time_t sec = rec->ts / 1000000000LL;
+  int len;
+
+  localtime_r(&sec, &tm);
+  len = strftime(out, 32, "%H:%M:%S", &tm);
+  len += sprintf(out + len, ".%06lld %-5s ", (rec->ts % 1000000000LL) / 1000, level_names[rec->level]);
+  if (strstr(rec->fmt, "%s"))
+    len += snprintf(out + len, MAXLINE, rec->fmt, rec->s, rec->args[0], rec->args[1], rec->args[2], rec->args[3]);
+  else
+    len += snprintf(out + len, MAXLINE, rec->fmt, rec->args[0], rec->args[1], rec->args[2], rec->args[3]);
+  if (len > 0 && out[len - 1] != '\n')
+    out[len++] = '\n';
+  return len;
+}
+
+static void *log_thread(void *vargp)
+{
+  static char out[LOG_OUTBUF];
+  long dropped, reported = 0;
+  unsigned head, tail;
+  int i, len;
+  log_ring_t *r;
+
+  Pthread_detach(pthread_self());
+  while (1)
+  {
+    len = 0;
+    for (i = 0; i < LOG_RINGS; i++)
+    {
+      r = &rings[i];
+      tail = r->tail;
+      head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+      for (; tail != head; tail++)
+      {
+        if (len > LOG_OUTBUF - MAXLINE - LOG_STRLEN - 64)
+        {
+          rio_writen(STDOUT_FILENO, out, len);
+          len = 0;
+        }
+        len += format_rec(out + len, &r->recs[tail & (LOG_RING_SIZE - 1)]);
+      }
+      __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    if ((dropped = log_dropped()) != reported)
+    {
+      len += sprintf(out + len, "log: %ld records dropped so far\n", dropped);
+      reported = dropped;
+    }
+    if (len > 0)
+      rio_writen(STDOUT_FILENO, out, len);
+    else
+      usleep(LOG_FLUSH_US);
+  }
+  return NULL;
+}
+
+static void level_handler(int sig)
+{
+  if (sig == SIGUSR1 && log_level < LOG_DEBUG)
+    log_level++;
+  else if (sig == SIGUSR2 && log_level > LOG_ERROR)
+    log_level--;
+}
+
+int log_parse_level(const char *name)
+{
+  int i;
+
+  for (i = LOG_ERROR; i <= LOG_DEBUG; i++)
+    if (!strcasecmp(name, level_names[i]))
+      return i;
+  return -1;
+}
+
+const char *log_level_name(log_level_t level)
+{
+  return level_names[level];
+}
+
+void log_init(log_level_t level)
+{
+  pthread_t tid;
+
+  log_level = level;
+  pthread_key_create(&ring_key, ring_release);
+  Signal(SIGUSR1, level_handler);
+  Signal(SIGUSR2, level_handler);
+  Pthread_create(&tid, NULL, log_thread, NULL);
+}
@@ -0,0 +1,50 @@
+/*
+ * log.h - 요청 처리 경로를 막지 않는 비동기 로그
+ *
+ * 각 쓰레드는 자기 전용 ring buffer(SPSC)에 고정 크기 binary record를 넣기만 하고,
+ * 문자열 포맷과 write()는 백그라운드 쓰레드 하나가 모아서 한다.
+ * ring이 가득 차면 기다리지 않고 record를 버리며, 버린 개수는 log_dropped()로 센다.
+ *
+ * 로그 레벨은 실행 중에 바꿀 수 있다: SIGUSR1 = 더 자세히, SIGUSR2 = 덜 자세히.
+ */
+#ifndef __LOG_H__
+#define __LOG_H__
+
+#include "csapp.h"
+
+typedef enum
+{
+  LOG_ERROR,
+  LOG_WARN,
+  LOG_INFO,
+  LOG_DEBUG
+} log_level_t;
+
+#define LOG_ARGS 4     /* record 하나에 담는 정수 인자 수 */
+#define LOG_STRLEN 200 /* record 하나에 담는 문자열 길이 (넘으면 잘린다) */
+
+extern volatile int log_level; /* 이 값 이하의 레벨만 기록 */
+
+/* 백그라운드 쓰레드를 띄우고 SIGUSR1/SIGUSR2 핸들러를 설치한다 */
+void log_init(log_level_t level);
+
+/* name("error", "warn", "info", "debug")에 해당하는 레벨, 모르면 -1 */
+int log_parse_level(const char *name);
+const char *log_level_name(log_level_t level);
+
+/* fmt은 백그라운드 쓰레드가 나중에 포맷하므로 문자열 상수여야 한다.
+   변환은 %ld를 LOG_ARGS개까지 쓸 수 있고, s를 찍으려면 %s를 맨 앞 변환으로 한 번만 쓴다.
+   s는 record 안에 LOG_STRLEN까지 복사된다 */
+void log_write(log_level_t level, const char *fmt, const char *s, const long *args);
+
+#define LOGF(level, fmt, s, ...)                                         \
+  do                                                                     \
+  {                                                                      \
+    if ((level) <= log_level)                                            \
+      log_write((level), (fmt), (s), (long[LOG_ARGS]){__VA_ARGS__});     \
+  } while (0)
+
+/* ring이 가득 차서 버린 record 수 */
+long log_dropped(void);
+
+#endif /* __LOG_H__ */
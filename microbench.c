@@ -0,0 +1,291 @@
+/*
+ * microbench.c - 요청 파싱과 header 만들기 함수의 microbenchmark
+ *
+ * usage: ./microbench [-n iterations] [-r repeats] [name...]
+ *
+ * proxy.c의 parse_uri(), build_http_header()와 tiny.c의 parse_uri(), read_requesthdrs(),
+ * get_filetype()을 socket 없이 메모리의 request line/header 묶음으로 돌린다. header는 rio_t
+ * 버퍼에 미리 채워 두고 매번 버퍼 포인터만 되감으므로 read()는 일어나지 않는다.
+ * proxy.c와 tiny.c는 main 등 겹치는 이름만 바꿔 그대로 링크한다 (Makefile).
+ *
+ * 함수마다 ns/op(repeats번 중 가장 빠른 것), instructions/op(perf_event_open, user만. 쓸 수 없으면
+ * n/a), allocations/op(malloc/calloc/realloc 호출 수, 링크할 때 --wrap으로 센다)를 출력한다.
+ * name을 주면 이름에 그 문자열이 들어간 것만 돌린다. 로그는 끄고 잰다.
+ */
+#include "csapp.h"
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include "arena.h"
+#include "hist.h"
+#include "log.h"
+
+#define DEFAULT_ITERS 1000000
+#define DEFAULT_REPEATS 5
+
+/* proxy.c */
+void parse_uri(char *uri, char *hostname, char *path, int *port);
+char *build_http_header(arena_t *arena, char *hostname, char *path, int port, rio_t *client_rio);
+
+/* tiny/tiny.c (parse_uri는 tiny_parse_uri로 바꿔 컴파일한다) */
+int tiny_parse_uri(char *uri, char *filename, char *cgiargs);
+char *read_requesthdrs(arena_t *arena, rio_t *rp);
+void get_filetype(char *filename, char *filetype);
+
+/* proxy가 client에게서 받는 absolute URI */
+static const char *proxy_uris[] = {
+    "http://localhost:15213/home.html",
+    "http://www.cmu.edu/hub/index.html",
+    "http://example.com:8080/api/v1/items?id=42&sort=desc",
+    "http://cdn.example.net/static/js/app.3f2a9c1e.min.js",
+    "http://images.example.org/photos/2016/02/08/godzilla.jpg",
+    "http://localhost:15214/cgi-bin/adder?15000&213",
+};
+
+/* tiny가 받는 origin-form URI */
+static const char *tiny_uris[] = {
+    "/",
+    "/home.html",
+    "/godzilla.jpg",
+    "/cgi-bin/adder?15000&213",
+    "/static/css/site.min.css",
+    "/videos/puppy.mp4",
+};
+
+static const char *filenames[] = {
+    "./home.html",
+    "./godzilla.gif",
+    "./godzilla.jpg",
+    "./puppy.mp4",
+    "./static/css/site.min.css",
+    "./notes.txt",
+};
+
+/* request line 다음의 header 묶음 (빈 줄까지) */
+static const char *header_blocks[] = {
+    /* curl */
+    "Host: localhost:15213\r\n"
+    "User-Agent: curl/7.88.1\r\n"
+    "Accept: */*\r\n"
+    "Proxy-Connection: Keep-Alive\r\n"
+    "\r\n",
+    /* browser */
+    "Host: www.cmu.edu\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/115.0\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+    "Accept-Language: ko-KR,ko;q=0.8,en-US;q=0.5,en;q=0.3\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Referer: http://www.cmu.edu/\r\n"
+    "Cookie: _ga=GA1.2.1234567890.1700000000; _gid=GA1.2.987654321.1700000000; session=9f8e7d6c5b4a39281706f5e4d3c2b1a0\r\n"
+    "Connection: keep-alive\r\n"
+    "Proxy-Connection: keep-alive\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "\r\n",
+    /* 동영상 탐색 */
+    "Host: localhost:15213\r\n"
+    "User-Agent: Lavf/59.27.100\r\n"
+    "Accept: */*\r\n"
+    "Range: bytes=1048576-\r\n"
+    "Icy-MetaData: 1\r\n"
+    "Connection: close\r\n"
+    "\r\n",
+    /* Host 없는 HTTP/1.0 */
+    "User-Agent: Wget/1.21.3\r\n"
+    "Accept: */*\r\n"
+    "\r\n",
+};
+
+#define NELEMS(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+static char *uris[NELEMS(proxy_uris)];
+static rio_t rios[NELEMS(header_blocks)];
+static int rio_lens[NELEMS(header_blocks)];
+static arena_t arena;
+
+/* 링크할 때 -Wl,--wrap=malloc 등으로 이쪽을 거친다 */
+static long nallocs;
+void *__real_malloc(size_t n);
+void *__real_calloc(size_t nmemb, size_t n);
+void *__real_realloc(void *p, size_t n);
+
+void *__wrap_malloc(size_t n)
+{
+  nallocs++;
+  return __real_malloc(n);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t n)
+{
+  nallocs++;
+  return __real_calloc(nmemb, n);
+}
+
+void *__wrap_realloc(void *p, size_t n)
+{
+  nallocs++;
+  return __real_realloc(p, n);
+}
+
+/* 이 쓰레드의 user 명령어 수. 쓸 수 없으면 -1 */
+static int counter_open(void)
+{
+  struct perf_event_attr pe;
+
+  memset(&pe, 0, sizeof(pe));
+  pe.type = PERF_TYPE_HARDWARE;
+  pe.size = sizeof(pe);
+  pe.config = PERF_COUNT_HW_INSTRUCTIONS;
+  pe.disabled = 1;
+  pe.exclude_kernel = 1;
+  pe.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0);
+}
+
+/* i번째 header 묶음을 처음부터 다시 읽게 한다 */
+static rio_t *rewind_rio(int i)
+{
+  rio_t *rp = &rios[i % NELEMS(header_blocks)];
+
+  rp->rio_bufptr = rp->rio_buf;
+  rp->rio_cnt = rio_lens[i % NELEMS(header_blocks)];
+  return rp;
+}
+
+static void proxy_parse_uri(int i)
+{
+  char hostname[MAXLINE], path[MAXLINE];
+  int port;
+
+  strcpy(path, "/");
+  parse_uri(uris[i % NELEMS(proxy_uris)], hostname, path, &port);
+}
+
+static void proxy_build_http_header(int i)
+{
+  arena_reset(&arena);
+  build_http_header(&arena, "www.cmu.edu", "/hub/index.html", 80, rewind_rio(i));
+}
+
+/* '?'를 잘라 내므로 매번 복사해서 넘긴다 */
+static void tiny_parse_uri_bench(int i)
+{
+  char uri[MAXLINE], filename[MAXLINE], cgiargs[MAXLINE];
+
+  strcpy(uri, tiny_uris[i % NELEMS(tiny_uris)]);
+  tiny_parse_uri(uri, filename, cgiargs);
+}
+
+static void tiny_read_requesthdrs(int i)
+{
+  arena_reset(&arena);
+  read_requesthdrs(&arena, rewind_rio(i));
+}
+
+static void tiny_get_filetype(int i)
+{
+  char filetype[MAXLINE];
+
+  get_filetype((char *)filenames[i % NELEMS(filenames)], filetype);
+}
+
+static const struct
+{
+  const char *name;
+  void (*fn)(int i);
+} benches[] = {
+    {"proxy_parse_uri", proxy_parse_uri},
+    {"proxy_build_http_header", proxy_build_http_header},
+    {"tiny_parse_uri", tiny_parse_uri_bench},
+    {"tiny_read_requesthdrs", tiny_read_requesthdrs},
+    {"tiny_get_filetype", tiny_get_filetype},
+};
+
+static void run(const char *name, void (*fn)(int), long iters, int repeats, int counter)
+{
+  long long start, ns, best = -1, insns = -1, count;
+  long i, allocs = 0;
+  int r;
+
+  /* 캐시와 분기 예측을 데운다 */
+  for (i = 0; i < iters / 10; i++)
+    fn(i);
+  for (r = 0; r < repeats; r++)
+  {
+    nallocs = 0;
+    if (counter >= 0)
+    {
+      ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+      ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    start = hist_now();
+    for (i = 0; i < iters; i++)
+      fn(i);
+    ns = hist_now() - start;
+    if (counter >= 0)
+    {
+      ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+      if (read(counter, &count, sizeof(count)) == sizeof(count) && (insns < 0 || count < insns))
+        insns = count;
+    }
+    if (best < 0 || ns < best)
+      best = ns;
+    allocs = nallocs;
+  }
+  printf("%-26s %10.1f", name, (double)best / iters);
+  if (insns >= 0)
+    printf(" %12.1f", (double)insns / iters);
+  else
+    printf(" %12s", "n/a");
+  printf(" %10.3f\n", (double)allocs / iters);
+}
+
+int main(int argc, char **argv)
+{
+  long iters = DEFAULT_ITERS;
+  int opt, i, j, repeats = DEFAULT_REPEATS, counter;
+
+  while ((opt = getopt(argc, argv, "n:r:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+      iters = atol(optarg);
+      break;
+    case 'r':
+      repeats = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n iterations] [-r repeats] [name...]\n", argv[0]);
+      exit(1);
+    }
+  }
+  if (iters <= 0 || repeats <= 0)
+  {
+    fprintf(stderr, "%s: iterations and repeats must be positive\n", argv[0]);
+    exit(1);
+  }
+
+  log_level = LOG_ERROR;
+  arena_init(&arena, ARENA_BLOCK);
+  for (i = 0; i < NELEMS(proxy_uris); i++)
+    uris[i] = strdup(proxy_uris[i]);
+  for (i = 0; i < NELEMS(header_blocks); i++)
+  {
+    rio_readinitb(&rios[i], -1);
+    rio_lens[i] = strlen(header_blocks[i]);
+    memcpy(rios[i].rio_buf, header_blocks[i], rio_lens[i]);
+  }
+  if ((counter = counter_open()) < 0)
+    fprintf(stderr, "perf_event_open: %s (instructions/op not available)\n", strerror(errno));
+
+  printf("%-26s %10s %12s %10s\n", "benchmark", "ns/op", "instr/op", "allocs/op");
+  for (i = 0; i < NELEMS(benches); i++)
+  {
+    for (j = optind; j < argc && !strstr(benches[i].name, argv[j]); j++)
+      ;
+    if (optind < argc && j == argc)
+      continue;
+    run(benches[i].name, benches[i].fn, iters, repeats, counter);
+  }
+  return 0;
+}
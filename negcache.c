@@ -0,0 +1,113 @@
+/*
+ * negcache.c - 오류 응답 TTL과 host:port 연결 실패 기억
+ */
+#include "csapp.h"
+#include "negcache.h"
+#include "cachekey.h"
+#include "hist.h"
+#include "config.h"
+
+typedef struct
+{
+  uint64_t hash;  /* "host:port"의 cachekey_hash. 0이면 빈 slot */
+  int err;
+  long long until; /* hist_now() 기준 */
+} neg_t;
+
+static neg_t slots[NEG_SLOTS];
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int negcache_config(neg_ttl_t *t, const char *spec)
+{
+  char buf[MAXLINE], *tok, *save, *eq;
+  int ttl, code, i;
+
+  if (strlen(spec) >= MAXLINE)
+    return -1;
+  strcpy(buf, spec);
+  for (tok = strtok_r(buf, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save))
+  {
+    if ((eq = strchr(tok, '=')) == NULL || !isdigit((unsigned char)eq[1]))
+      return -1;
+    *eq = '\0';
+    ttl = atoi(eq + 1);
+    if (!strcasecmp(tok, "dns"))
+      t->dns = ttl;
+    else if (!strcasecmp(tok, "connect"))
+      t->connect = ttl;
+    else if (strlen(tok) == 3 && tok[0] >= '1' && tok[0] <= '5' && !strcasecmp(tok + 1, "xx"))
+      for (code = (tok[0] - '0') * 100, i = 0; i < 100; i++)
+        t->status[code + i] = ttl;
+    else if (strlen(tok) == 3 && (code = atoi(tok)) >= 100 && code < 600)
+      t->status[code] = ttl;
+    else
+      return -1;
+  }
+  return 0;
+}
+
+int negcache_format(const neg_ttl_t *t, char *buf)
+{
+  int len = 0, code, i;
+
+  /* 100개가 모두 같은 status 묶음은 "Nxx"로 줄인다 */
+  for (code = 100; code < 600; code += 100)
+  {
+    for (i = 1; i < 100 && t->status[code + i] == t->status[code]; i++)
+      ;
+    if (i == 100)
+    {
+      if (t->status[code])
+        len += sprintf(buf + len, "%dxx=%d,", code / 100, t->status[code]);
+      continue;
+    }
+    for (i = 0; i < 100; i++)
+      if (t->status[code + i])
+        len += sprintf(buf + len, "%d=%d,", code + i, t->status[code + i]);
+  }
+  return len + sprintf(buf + len, "dns=%d,connect=%d", t->dns, t->connect);
+}
+
+int negcache_status_ttl(int status)
+{
+  return status >= 100 && status < 600 ? config_get()->neg.status[status] : 0;
+}
+
+static uint64_t host_hash(const char *host, int port)
+{
+  char buf[MAXLINE];
+  uint64_t hash;
+
+  snprintf(buf, sizeof(buf), "%s:%d", host, port);
+  hash = cachekey_hash(buf);
+  return hash ? hash : 1;
+}
+
+int negcache_check(const char *host, int port)
+{
+  uint64_t hash = host_hash(host, port);
+  neg_t *n = &slots[hash & (NEG_SLOTS - 1)];
+  int err = 0;
+
+  pthread_mutex_lock(&mutex);
+  if (n->hash == hash && n->until > hist_now())
+    err = n->err;
+  pthread_mutex_unlock(&mutex);
+  return err;
+}
+
+void negcache_fail(const char *host, int port, int err, int dns)
+{
+  uint64_t hash = host_hash(host, port);
+  neg_t *n = &slots[hash & (NEG_SLOTS - 1)];
+  int ttl = dns ? config_get()->neg.dns : config_get()->neg.connect;
+
+  if (ttl <= 0)
+    return;
+  /* 같은 slot의 다른 host는 덮어쓴다. 잊어버려도 한 번 더 시도할 뿐이다 */
+  pthread_mutex_lock(&mutex);
+  n->hash = hash;
+  n->err = err;
+  n->until = hist_now() + ttl * 1000000000LL;
+  pthread_mutex_unlock(&mutex);
+}
@@ -0,0 +1,41 @@
+/*
+ * negcache.h - 실패를 짧게 기억하는 negative cache
+ *
+ * 같은 URL이 계속 404를 받거나 host가 resolve되지 않는데 client가 재시도를 반복하면, 그때마다
+ * getaddrinfo()와 end server 왕복을 다시 하게 된다. 그래서 실패도 잠깐 캐시한다.
+ *   - 404/410/5xx 같은 오류 응답: 보통 캐시에 status별 TTL로 넣는다 (max-age가 있으면 그것)
+ *   - DNS/connect 실패: host:port마다 errno를 TTL 동안 기억해, 그 사이 connect는 바로 실패한다
+ * TTL은 -N "404=10,410=60,5xx=2,dns=5,connect=2" 식으로 준다. 0이면 캐시하지 않는다.
+ * TTL 표는 실행 설정(config.h)에 들어 있어 설정 파일을 다시 읽으면 바뀐다.
+ */
+#ifndef __NEGCACHE_H__
+#define __NEGCACHE_H__
+
+#include "csapp.h"
+
+#define NEG_SLOTS 256 /* 기억하는 host:port 수 (direct-mapped, 2의 거듭제곱) */
+#define DEFAULT_NEG_SPEC "404=10,410=60,5xx=2,dns=5,connect=2"
+
+typedef struct
+{
+  int status[600]; /* status별 TTL (초) */
+  int dns, connect;
+} neg_ttl_t;
+
+/* "status=s", "Nxx=s", "dns=s", "connect=s"를 ','로 이은 것. t에서 준 항목만 바꾼다. 틀리면 -1 */
+int negcache_config(neg_ttl_t *t, const char *spec);
+
+/* t를 negcache_config()가 읽는 형식으로 buf에 쓴다 (0인 status는 뺀다). 길이를 반환.
+   buf는 MAXBUF면 충분하다 */
+int negcache_format(const neg_ttl_t *t, char *buf);
+
+/* 이 status의 응답을 캐시할 TTL (초). 0이면 캐시하지 않는다 */
+int negcache_status_ttl(int status);
+
+/* host:port에 대해 기억하는 실패의 errno. 없거나 TTL이 지났으면 0 */
+int negcache_check(const char *host, int port);
+
+/* host:port의 실패를 기억한다. dns면 dns TTL, 아니면 connect TTL */
+void negcache_fail(const char *host, int port, int err, int dns);
+
+#endif /* __NEGCACHE_H__ */
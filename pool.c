@@ -0,0 +1,424 @@
+/*
+ * pool.c - backend pool, route, least outstanding / power-of-two-choices 선택
+ */
+#include "csapp.h"
+#include <limits.h>
+#include "pool.h"
+#include "hist.h"
+#include "stats.h"
+#include "log.h"
+#include "config.h"
+
+typedef struct
+{
+  char host[POOL_HOSTLEN]; /* 비어 있으면 모든 host */
+  char prefix[POOL_HOSTLEN];
+  char name[POOL_NAMELEN];
+  pool_t *pool; /* pool_check()가 채운다 */
+} route_t;
+
+struct pool_table
+{
+  pool_t pools[POOL_MAX];
+  int npools;
+  route_t routes[ROUTE_MAX];
+  int nroutes;
+  balance_t balance;
+};
+
+pool_table_t *pool_table_new(void)
+{
+  pool_table_t *t = Calloc(1, sizeof(pool_table_t));
+
+  t->balance = BALANCE_LEAST;
+  return t;
+}
+
+pool_table_t *pool_table_copy(const pool_table_t *t)
+{
+  pool_table_t *n = Malloc(sizeof(pool_table_t));
+  int i, j;
+
+  memcpy(n, t, sizeof(pool_table_t));
+  for (i = 0; i < n->npools; i++)
+  {
+    n->pools[i].next = 0;
+    for (j = 0; j < n->pools[i].n; j++)
+    {
+      n->pools[i].backends[j].outstanding = 0;
+      n->pools[i].backends[j].served = 0;
+      n->pools[i].backends[j].fails = 0;
+      n->pools[i].backends[j].ejected_until = 0;
+      n->pools[i].backends[j].backoff_ms = BACKOFF_MIN_MS;
+    }
+  }
+  /* route는 원래 table의 pool을 가리키고 있다 */
+  for (i = 0; i < n->nroutes; i++)
+    if (n->routes[i].pool != NULL)
+      n->routes[i].pool = &n->pools[t->routes[i].pool - t->pools];
+  return n;
+}
+
+void pool_table_clear(pool_table_t *t)
+{
+  t->npools = 0;
+  t->nroutes = 0;
+}
+
+void pool_table_free(pool_table_t *t)
+{
+  Free(t);
+}
+
+static pool_t *find_pool(pool_table_t *t, const char *name)
+{
+  int i;
+
+  for (i = 0; i < t->npools; i++)
+    if (!strcmp(t->pools[i].name, name))
+      return &t->pools[i];
+  return NULL;
+}
+
+static backend_t *find_backend(pool_t *pool, const char *host, int port)
+{
+  int i;
+
+  for (i = 0; i < pool->n; i++)
+    if (pool->backends[i].port == port && !strcmp(pool->backends[i].host, host))
+      return &pool->backends[i];
+  return NULL;
+}
+
+void pool_table_inherit(pool_table_t *t, pool_table_t *old)
+{
+  pool_t *pool;
+  backend_t *b, *o;
+  int i, j;
+
+  for (i = 0; i < t->npools; i++)
+  {
+    if ((pool = find_pool(old, t->pools[i].name)) == NULL)
+      continue;
+    for (j = 0; j < t->pools[i].n; j++)
+    {
+      b = &t->pools[i].backends[j];
+      if ((o = find_backend(pool, b->host, b->port)) == NULL)
+        continue;
+      b->served = __atomic_load_n(&o->served, __ATOMIC_RELAXED);
+      b->fails = __atomic_load_n(&o->fails, __ATOMIC_RELAXED);
+      b->ejected_until = __atomic_load_n(&o->ejected_until, __ATOMIC_RELAXED);
+      b->backoff_ms = __atomic_load_n(&o->backoff_ms, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+int pool_define(pool_table_t *t, const char *spec)
+{
+  char buf[MAXLINE], *eq, *tok, *save, *colon;
+  pool_t *pool;
+  backend_t *b;
+
+  if (t->npools == POOL_MAX || strlen(spec) >= MAXLINE)
+    return -1;
+  strcpy(buf, spec);
+  if ((eq = strchr(buf, '=')) == NULL || eq == buf || eq - buf >= (int)sizeof(pool->name))
+    return -1;
+  *eq = '\0';
+  if (find_pool(t, buf) != NULL)
+    return -1;
+  pool = &t->pools[t->npools];
+  strcpy(pool->name, buf);
+  pool->n = 0;
+  for (tok = strtok_r(eq + 1, ",", &save); tok; tok = strtok_r(NULL, ",", &save))
+  {
+    if (pool->n == BACKEND_MAX || (colon = strrchr(tok, ':')) == NULL || colon == tok || colon - tok >= POOL_HOSTLEN)
+      return -1;
+    b = &pool->backends[pool->n++];
+    *colon = '\0';
+    strcpy(b->host, tok);
+    if ((b->port = atoi(colon + 1)) <= 0)
+      return -1;
+    b->backoff_ms = BACKOFF_MIN_MS;
+  }
+  if (pool->n == 0)
+    return -1;
+  t->npools++;
+  return 0;
+}
+
+int pool_route_add(pool_table_t *t, const char *spec)
+{
+  char buf[MAXLINE], *eq, *slash;
+  route_t *r;
+
+  if (t->nroutes == ROUTE_MAX || strlen(spec) >= POOL_HOSTLEN)
+    return -1;
+  strcpy(buf, spec);
+  if ((eq = strrchr(buf, '=')) == NULL || strlen(eq + 1) >= sizeof(r->name))
+    return -1;
+  *eq = '\0';
+  r = &t->routes[t->nroutes++];
+  strcpy(r->name, eq + 1);
+  if ((slash = strchr(buf, '/')) != NULL)
+  {
+    strcpy(r->prefix, slash);
+    *slash = '\0';
+  }
+  else
+    r->prefix[0] = '\0';
+  strcpy(r->host, buf);
+  return 0;
+}
+
+int pool_set_balance(pool_table_t *t, const char *name)
+{
+  if (!strcasecmp(name, "least"))
+    t->balance = BALANCE_LEAST;
+  else if (!strcasecmp(name, "p2c"))
+    t->balance = BALANCE_P2C;
+  else
+    return -1;
+  return 0;
+}
+
+const char *pool_balance_name(pool_table_t *t)
+{
+  return t->balance == BALANCE_P2C ? "p2c" : "least";
+}
+
+int pool_check(pool_table_t *t)
+{
+  int i;
+  route_t *r;
+
+  for (i = 0; i < t->nroutes; i++)
+  {
+    r = &t->routes[i];
+    if ((r->pool = find_pool(t, r->name)) == NULL)
+    {
+      fprintf(stderr, "route %s%s: no pool named %s\n", r->host, r->prefix, r->name);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int pool_enabled(void)
+{
+  return config_get()->pools->npools > 0;
+}
+
+pool_t *pool_route(const char *host, const char *path)
+{
+  pool_table_t *t = config_get()->pools;
+  int i;
+  route_t *r;
+
+  for (i = 0; i < t->nroutes; i++)
+  {
+    r = &t->routes[i];
+    if (r->host[0] && strcasecmp(r->host, host))
+      continue;
+    if (r->prefix[0] && strncmp(r->prefix, path, strlen(r->prefix)))
+      continue;
+    return r->pool;
+  }
+  return NULL;
+}
+
+/* 쓰레드마다 따로 도는 xorshift. p2c에서 두 후보를 뽑는 데만 쓴다 */
+static unsigned rand_next(void)
+{
+  static __thread unsigned x;
+
+  /* 쓰레드 주소만으로는 하위 비트가 모두 같아 첫 선택이 한쪽으로 쏠린다: 시각을 섞는다 */
+  if (x == 0)
+    x = ((unsigned)hist_now() ^ (unsigned)pthread_self() * 2654435761u) | 1;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x;
+}
+
+/* 빠진 backend는 무한대로 바쁜 것처럼 보이게 해서 선택 규칙 하나로 건너뛴다 */
+static long load(backend_t *b, long long now)
+{
+  long long until = __atomic_load_n(&b->ejected_until, __ATOMIC_RELAXED);
+
+  if (until != 0 && now < until)
+    return LONG_MAX;
+  return __atomic_load_n(&b->outstanding, __ATOMIC_RELAXED);
+}
+
+backend_t *pool_acquire(pool_t *pool)
+{
+  backend_t *best, *b;
+  unsigned start;
+  int i;
+  long long now = hist_now();
+
+  if (pool->n == 1)
+    best = &pool->backends[0];
+  else if (config_get()->pools->balance == BALANCE_P2C)
+  {
+    best = &pool->backends[rand_next() % pool->n];
+    b = &pool->backends[rand_next() % pool->n];
+    if (load(b, now) < load(best, now))
+      best = b;
+    /* 둘 다 빠져 있으면 정상인 backend를 찾아본다 */
+    for (i = 0; i < pool->n && load(best, now) == LONG_MAX; i++)
+      best = &pool->backends[i];
+  }
+  else
+  {
+    /* 모두 한가하면 늘 첫 backend만 쓰지 않도록 시작 위치를 돌린다 */
+    start = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+    best = &pool->backends[start % pool->n];
+    for (i = 1; i < pool->n; i++)
+    {
+      b = &pool->backends[(start + i) % pool->n];
+      if (load(b, now) < load(best, now))
+        best = b;
+    }
+  }
+  __atomic_fetch_add(&best->outstanding, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&best->served, 1, __ATOMIC_RELAXED);
+  return best;
+}
+
+void pool_release(backend_t *b)
+{
+  __atomic_fetch_sub(&b->outstanding, 1, __ATOMIC_RELAXED);
+}
+
+void pool_report_result(backend_t *b, int ok)
+{
+  long long until, now;
+  int backoff;
+
+  if (ok)
+  {
+    __atomic_store_n(&b->fails, 0, __ATOMIC_RELAXED);
+    if (__atomic_exchange_n(&b->ejected_until, 0, __ATOMIC_RELAXED) != 0)
+    {
+      __atomic_store_n(&b->backoff_ms, BACKOFF_MIN_MS, __ATOMIC_RELAXED);
+      LOGF(LOG_INFO, "backend %s:%ld back in pool", b->host, b->port);
+    }
+    return;
+  }
+  if (__atomic_add_fetch(&b->fails, 1, __ATOMIC_RELAXED) < EJECT_FAILS)
+    return;
+
+  /* 이미 빠져 있는 중이면 그대로. backoff가 지난 뒤의 시험이 실패했으면 두 배로 */
+  now = hist_now();
+  until = __atomic_load_n(&b->ejected_until, __ATOMIC_RELAXED);
+  if (until != 0 && now < until)
+    return;
+  backoff = __atomic_load_n(&b->backoff_ms, __ATOMIC_RELAXED);
+  if (!__atomic_compare_exchange_n(&b->ejected_until, &until, now + backoff * 1000000LL, 0,
+                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    return;
+  __atomic_store_n(&b->backoff_ms, backoff * 2 < BACKOFF_MAX_MS ? backoff * 2 : BACKOFF_MAX_MS, __ATOMIC_RELAXED);
+  stats_inc(STAT_BACKEND_EJECTIONS);
+  LOGF(LOG_WARN, "backend %s:%ld ejected from pool for %ld ms", b->host, b->port, backoff);
+}
+
+/* HEAD / 를 보내 응답 status가 5xx가 아니면 1. connect와 응답 모두 PROBE_TIMEOUT_MS 안에 */
+static int probe(backend_t *b)
+{
+  char portstr[16], buf[MAXLINE];
+  struct addrinfo hints, *listp, *p;
+  struct timeval tv = {PROBE_TIMEOUT_MS / 1000, (PROBE_TIMEOUT_MS % 1000) * 1000};
+  rio_t rio;
+  int fd = -1, status = 0;
+
+  sprintf(portstr, "%d", b->port);
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG;
+  if (getaddrinfo(b->host, portstr, &hints, &listp) != 0)
+    return 0;
+  for (p = listp; p; p = p->ai_next)
+  {
+    if ((fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) < 0)
+      continue;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (connect(fd, p->ai_addr, p->ai_addrlen) == 0)
+      break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(listp);
+  if (fd < 0)
+    return 0;
+
+  sprintf(buf, "HEAD / HTTP/1.0\r\nHost: %s\r\nConnection: close\r\n\r\n", b->host);
+  rio_readinitb(&rio, fd);
+  if (rio_writen(fd, buf, strlen(buf)) > 0 && rio_readlineb(&rio, buf, MAXLINE) > 0)
+    sscanf(buf, "HTTP/%*s %d", &status);
+  close(fd);
+  return status >= 100 && status < 500;
+}
+
+static void *probe_thread(void *vargp)
+{
+  int interval_ms = (int)(long)vargp, i, j;
+  pool_table_t *t;
+  backend_t *b;
+  long long until;
+
+  Pthread_detach(pthread_self());
+  while (1)
+  {
+    /* 한 바퀴는 같은 table로. 설정이 바뀌었으면 다음 바퀴부터 새 table을 본다 */
+    config_refresh();
+    t = config_get()->pools;
+    for (i = 0; i < t->npools; i++)
+      for (j = 0; j < t->pools[i].n; j++)
+      {
+        b = &t->pools[i].backends[j];
+        /* backoff가 끝나지 않은 backend는 건드리지 않는다 */
+        until = __atomic_load_n(&b->ejected_until, __ATOMIC_RELAXED);
+        if (until != 0 && hist_now() < until)
+          continue;
+        pool_report_result(b, probe(b));
+      }
+    usleep(interval_ms * 1000);
+  }
+  return NULL;
+}
+
+void pool_start_probes(int interval_ms, int reloadable)
+{
+  pthread_t tid;
+
+  /* 설정 파일로 나중에 pool이 생길 수 있으면 지금 pool이 없어도 띄워 둔다 */
+  if ((pool_enabled() || reloadable) && interval_ms > 0)
+    Pthread_create(&tid, NULL, probe_thread, (void *)(long)interval_ms);
+}
+
+void pool_report(FILE *out, int json)
+{
+  pool_table_t *t = config_get()->pools;
+  int i, j, n = 0, ejected;
+  backend_t *b;
+  long outstanding, served;
+  long long now = hist_now();
+
+  for (i = 0; i < t->npools; i++)
+    for (j = 0; j < t->pools[i].n; j++)
+    {
+      b = &t->pools[i].backends[j];
+      outstanding = __atomic_load_n(&b->outstanding, __ATOMIC_RELAXED);
+      served = __atomic_load_n(&b->served, __ATOMIC_RELAXED);
+      ejected = load(b, now) == LONG_MAX;
+      if (json)
+        fprintf(out, "%s\"%s %s:%d\": {\"outstanding\": %ld, \"served\": %ld, \"ejected\": %d}",
+                n++ ? ", " : "", t->pools[i].name, b->host, b->port, outstanding, served, ejected);
+      else
+        fprintf(out, "backend_%s_%s:%d outstanding %ld served %ld ejected %d\n",
+                t->pools[i].name, b->host, b->port, outstanding, served, ejected);
+    }
+}
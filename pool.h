@@ -0,0 +1,105 @@
+/*
+ * pool.h - reverse proxy 모드의 backend pool과 부하 분산
+ *
+ * -P name=host:port,host:port,... 로 이름 붙은 backend pool을 만들고,
+ * -r [host][/prefix]=name 으로 요청의 Host와 path를 pool에 연결한다. route는 주어진 순서대로
+ * 비교해 처음 맞는 것을 쓴다 (host를 비우면 모든 host, prefix를 비우면 모든 path).
+ *
+ * backend는 처리 중인 요청 수(outstanding)가 가장 적은 것을 고른다 (least outstanding).
+ * p2c를 고르면 임의의 두 backend만 비교한다. 카운터는 backend마다 atomic이라 lock이 없다.
+ *
+ * health check: 요청(passive)이나 백그라운드 HEAD / probe(active)가 연달아 EJECT_FAILS번
+ * 실패하면 backend를 backoff 동안 고르지 않는다. backoff가 지나면 probe나 요청 하나가
+ * 다시 시험해 보고, 성공하면 복귀, 실패하면 backoff를 두 배로 늘려 다시 뺀다.
+ * 모든 backend가 빠져 있으면 그래도 그중에서 고른다.
+ *
+ * pool과 route 정의는 pool_table_t 하나에 모이고, 그 table은 실행 설정(config.h)이 가진다.
+ * 설정을 다시 읽으면 새 table로 바뀌며, 같은 pool 이름과 host:port의 backend는 health 상태를
+ * 이어받는다. 요청 처리 중인 쓰레드는 요청이 끝날 때까지 예전 table의 backend를 쓴다.
+ */
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include "csapp.h"
+
+#define POOL_MAX 16    /* pool 수 */
+#define BACKEND_MAX 32 /* pool 하나의 backend 수 */
+#define ROUTE_MAX 64
+#define POOL_NAMELEN 64
+#define POOL_HOSTLEN 256 /* backend host, route host/prefix */
+
+#define EJECT_FAILS 3        /* 연속 실패가 이만큼이면 뺀다 */
+#define BACKOFF_MIN_MS 1000  /* 처음 빼는 시간 */
+#define BACKOFF_MAX_MS 30000
+#define DEFAULT_PROBE_MS 300 /* active probe 간격 */
+#define PROBE_TIMEOUT_MS 500 /* probe 하나의 connect/응답 deadline */
+
+typedef enum
+{
+  BALANCE_LEAST,
+  BALANCE_P2C
+} balance_t;
+
+typedef struct
+{
+  char host[POOL_HOSTLEN];
+  int port;
+  long outstanding;        /* atomic: 지금 이 backend에서 처리 중인 요청 */
+  long served;             /* atomic: 보낸 요청 수 */
+  int fails;               /* atomic: 연속 실패 수 */
+  long long ejected_until; /* atomic: 0이면 정상, 아니면 이 시각(hist_now)까지 빠짐 */
+  int backoff_ms;          /* atomic: 다음에 뺄 시간 */
+} backend_t;
+
+typedef struct
+{
+  char name[POOL_NAMELEN];
+  backend_t backends[BACKEND_MAX];
+  int n;
+  unsigned next; /* atomic: 동률일 때 검사 시작 위치를 돌린다 */
+} pool_t;
+
+typedef struct pool_table pool_table_t;
+
+pool_table_t *pool_table_new(void);
+/* 정의만 복사한다. 카운터와 health 상태는 처음 값 */
+pool_table_t *pool_table_copy(const pool_table_t *t);
+/* pool과 route를 모두 지운다 (balance는 그대로) */
+void pool_table_clear(pool_table_t *t);
+void pool_table_free(pool_table_t *t);
+
+/* "name=host:port,..." 와 "[host][/prefix]=name". 형식이 틀리면 -1 */
+int pool_define(pool_table_t *t, const char *spec);
+int pool_route_add(pool_table_t *t, const char *spec);
+int pool_set_balance(pool_table_t *t, const char *name);
+const char *pool_balance_name(pool_table_t *t);
+
+/* 정의를 다 읽은 뒤 route가 가리키는 pool을 찾아 둔다. 없는 pool이 있으면 -1 */
+int pool_check(pool_table_t *t);
+
+/* old에도 있는 backend(같은 pool 이름과 host:port)의 served와 health 상태를 t로 가져온다 */
+void pool_table_inherit(pool_table_t *t, pool_table_t *old);
+
+/* 아래는 이 쓰레드가 보고 있는 설정의 table을 쓴다 (config_get) */
+
+/* pool이 하나라도 있으면 reverse proxy 모드 */
+int pool_enabled(void);
+
+/* host와 path에 맞는 pool. 없으면 NULL */
+pool_t *pool_route(const char *host, const char *path);
+
+/* backend를 골라 outstanding을 올려 돌려준다. 요청이 끝나면 pool_release() */
+backend_t *pool_acquire(pool_t *pool);
+void pool_release(backend_t *b);
+
+/* 요청 결과를 알려준다 (passive health check). ok가 0이면 connect/응답 실패 */
+void pool_report_result(backend_t *b, int ok);
+
+/* interval_ms마다 모든 backend에 HEAD / 를 보내는 쓰레드를 띄운다.
+   reloadable이면 지금 pool이 없어도 설정이 바뀔 때를 위해 띄운다 */
+void pool_start_probes(int interval_ms, int reloadable);
+
+/* backend별 outstanding/served를 out에 쓴다 (stats_serve) */
+void pool_report(FILE *out, int json);
+
+#endif /* __POOL_H__ */
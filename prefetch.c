@@ -0,0 +1,276 @@
+/*
+ * prefetch.c - HTML 링크 추출, prefetch 대기열과 worker
+ */
+#include "csapp.h"
+#include "prefetch.h"
+#include "cache.h"
+#include "stats.h"
+#include "log.h"
+#include "cachekey.h"
+#include "config.h"
+#include "shm.h"
+
+static char queue[PREFETCH_QUEUE][MAXLINE]; /* 원형 대기열 */
+static int front, count;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t nonempty = PTHREAD_COND_INITIALIZER;
+
+static int enabled;
+static size_t budget;
+static size_t local_pending;
+static size_t *pending = &local_pending; /* atomic: 미리 받아 캐시에 넣었지만 아직 쓰이지 않은 바이트 */
+static prefetch_connect_t connect_fn;
+
+/* "http://host[:port]/path"를 나눈다. http가 아니면 -1 */
+static int split_url(char *url, char *host, int *port, char *path)
+{
+  char *p = url, *end;
+  size_t n;
+
+  if (strncasecmp(p, "http://", 7))
+    return -1;
+  p += 7;
+  end = p + strcspn(p, ":/");
+  if ((n = end - p) == 0 || n >= MAXLINE)
+    return -1;
+  memcpy(host, p, n);
+  host[n] = '\0';
+  *port = 80;
+  if (*end == ':')
+  {
+    *port = atoi(end + 1);
+    end += strcspn(end, "/");
+  }
+  strcpy(path, *end ? end : "/");
+  return 0;
+}
+
+void prefetch_share(void)
+{
+  pending = shm_alloc(sizeof(size_t));
+}
+
+void prefetch_settle(size_t size, int used)
+{
+  __atomic_fetch_sub(pending, size, __ATOMIC_RELAXED);
+  stats_add(used ? STAT_PREFETCH_USED : STAT_PREFETCH_WASTED, size);
+}
+
+/* budget 안이면 size만큼 pending을 잡는다 */
+static int pending_reserve(size_t size)
+{
+  size_t cur = __atomic_load_n(pending, __ATOMIC_RELAXED);
+
+  do
+  {
+    if (cur + size > budget)
+      return 0;
+  } while (!__atomic_compare_exchange_n(pending, &cur, cur + size, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  return 1;
+}
+
+static void fetch(char *url)
+{
+  char host[MAXLINE], path[MAXLINE], key[MAXLINE], buf[MAXLINE];
+  struct timeval tv = {PREFETCH_TIMEOUT_MS / 1000, (PREFETCH_TIMEOUT_MS % 1000) * 1000};
+  cache_fill_t fill;
+  rio_t rio;
+  ssize_t n;
+  size_t got = 0;
+  int port, fd;
+
+  if (split_url(url, host, &port, path) < 0 || cachekey_build(host, port, path, key, MAXLINE) < 0 ||
+      cache_contains(key))
+    return;
+  if (snprintf(buf, MAXLINE, "GET %s HTTP/1.0\r\nHost: %s\r\nConnection: close\r\nProxy-Connection: close\r\n\r\n",
+               path, host) >= MAXLINE)
+    return;
+  if ((fd = connect_fn(host, port, path)) < 0)
+    return;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  if (rio_writen(fd, buf, strlen(buf)) < 0)
+  {
+    close(fd);
+    return;
+  }
+
+  cache_fill_init(&fill);
+  rio_readinitb(&rio, fd);
+  /* 캐시할 수 없을 만큼 크면 더 받지 않는다 */
+  while ((n = rio_readnb(&rio, buf, MAXLINE)) > 0 && !fill.toobig)
+  {
+    cache_fill(&fill, buf, n);
+    got += n;
+  }
+  close(fd);
+  stats_add(STAT_BYTES_IN, got);
+  /* 캐시에 넣지 못한 것은 받은 만큼 모두 낭비. budget이 모자라도 버린다 */
+  if (n == 0 && cache_fill_ok(&fill) && cache_status(fill.buf, fill.len) == 200 && pending_reserve(fill.len))
+  {
+    /* 요청에 Host 말고는 header를 넣지 않았으므로 Vary 변형은 header가 없는 요청의 것이다 */
+    cache_insert(key, NULL, fill.buf, fill.len, 1);
+    stats_inc(STAT_PREFETCHES);
+    LOGF(LOG_DEBUG, "prefetched %s (%ld bytes)", url, (long)fill.len);
+  }
+  else
+    stats_add(STAT_PREFETCH_WASTED, got);
+  cache_fill_free(&fill);
+}
+
+static void *prefetch_thread(void *vargp)
+{
+  char url[MAXLINE];
+
+  Pthread_detach(pthread_self());
+  while (1)
+  {
+    pthread_mutex_lock(&mutex);
+    while (count == 0)
+      pthread_cond_wait(&nonempty, &mutex);
+    strcpy(url, queue[front]);
+    front = (front + 1) % PREFETCH_QUEUE;
+    count--;
+    pthread_mutex_unlock(&mutex);
+    config_refresh();
+    fetch(url);
+  }
+  return NULL;
+}
+
+/* 이미 대기 중인 URL이면 넣지 않는다. 대기열이 차면 버린다 */
+static void enqueue(char *url)
+{
+  int i;
+
+  pthread_mutex_lock(&mutex);
+  for (i = 0; i < count; i++)
+    if (!strcmp(queue[(front + i) % PREFETCH_QUEUE], url))
+      break;
+  if (i == count && count < PREFETCH_QUEUE)
+  {
+    strcpy(queue[(front + count++) % PREFETCH_QUEUE], url);
+    pthread_cond_signal(&nonempty);
+  }
+  pthread_mutex_unlock(&mutex);
+}
+
+/* link를 base(uri) 기준 absolute URL로 만든다. 다른 origin이거나 http가 아니면 -1 */
+static int resolve(char *base, char *link, char *url)
+{
+  char host[MAXLINE], bhost[MAXLINE], path[MAXLINE];
+  char *auth, *slash;
+  int port, bport;
+
+  if (split_url(base, bhost, &bport, path) < 0)
+    return -1;
+  link[strcspn(link, "#")] = '\0';
+  if (link[0] == '\0' || !strncmp(link, "//", 2))
+    return -1;
+  if (!strncasecmp(link, "http://", 7))
+  {
+    if (strlen(link) >= MAXLINE || split_url(link, host, &port, path) < 0)
+      return -1;
+    if (strcasecmp(host, bhost) || port != bport)
+      return -1;
+    strcpy(url, link);
+    return 0;
+  }
+  /* https:, mailto:, javascript: 같은 다른 scheme */
+  if (strcspn(link, ":") < strcspn(link, "/?"))
+    return -1;
+
+  auth = base + 7;
+  slash = strchr(auth, '/');
+  if (link[0] == '/')
+  {
+    /* "http://host:port" 까지 + link */
+    if ((slash ? slash - base : strlen(base)) + strlen(link) >= MAXLINE)
+      return -1;
+    sprintf(url, "%.*s%s", (int)(slash ? slash - base : strlen(base)), base, link);
+  }
+  else
+  {
+    /* base의 마지막 '/'까지 + link */
+    slash = strrchr(auth, '/');
+    if ((slash ? slash + 1 - base : strlen(base) + 1) + strlen(link) >= MAXLINE)
+      return -1;
+    if (slash)
+      sprintf(url, "%.*s%s", (int)(slash + 1 - base), base, link);
+    else
+      sprintf(url, "%s/%s", base, link);
+  }
+  return 0;
+}
+
+void prefetch_scan(char *uri, char *resp, size_t len)
+{
+  char *p, *end, *body, *ctype, link[MAXLINE], url[MAXLINE];
+  size_t n;
+  int links = 0, quote;
+
+  if (!enabled || __atomic_load_n(pending, __ATOMIC_RELAXED) >= budget)
+    return;
+  /* 응답은 NUL로 끝나지 않으므로 헤더와 본문 경계까지만 문자열 함수로 본다 */
+  end = resp + len;
+  for (body = resp; body + 4 <= end && memcmp(body, "\r\n\r\n", 4); body++)
+    ;
+  if (body + 4 > end)
+    return;
+  for (ctype = resp; ctype + 15 <= body; ctype++)
+    if (!strncasecmp(ctype, "\r\nContent-type:", 15))
+      break;
+  ctype += 15;
+  while (ctype < body && *ctype == ' ')
+    ctype++;
+  if (ctype >= body || strncasecmp(ctype, "text/html", 9))
+    return;
+
+  for (p = body + 4; p < end - 4 && links < PREFETCH_LINKS; p++)
+  {
+    if (!isspace((unsigned char)p[-1]))
+      continue;
+    if (!strncasecmp(p, "src", 3))
+      p += 3;
+    else if (end - p > 4 && !strncasecmp(p, "href", 4))
+      p += 4;
+    else
+      continue;
+    while (p < end && *p == ' ')
+      p++;
+    if (p >= end || *p++ != '=')
+      continue;
+    while (p < end && *p == ' ')
+      p++;
+    quote = p < end && (*p == '"' || *p == '\'') ? *p++ : 0;
+    for (n = 0; p + n < end && n < MAXLINE - 1; n++)
+      if (quote ? p[n] == quote : (isspace((unsigned char)p[n]) || p[n] == '>'))
+        break;
+    memcpy(link, p, n);
+    link[n] = '\0';
+    p += n;
+    if (resolve(uri, link, url) == 0 && strcmp(url, uri))
+    {
+      enqueue(url);
+      links++;
+    }
+  }
+}
+
+void prefetch_url(char *url)
+{
+  if (!enabled || __atomic_load_n(pending, __ATOMIC_RELAXED) >= budget || strlen(url) >= MAXLINE)
+    return;
+  enqueue(url);
+}
+
+void prefetch_init(int workers, size_t size, prefetch_connect_t connect)
+{
+  pthread_t tid;
+  int i;
+
+  enabled = workers > 0;
+  budget = size;
+  connect_fn = connect;
+  for (i = 0; i < workers; i++)
+    Pthread_create(&tid, NULL, prefetch_thread, NULL);
+}
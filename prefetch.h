@@ -0,0 +1,41 @@
+/*
+ * prefetch.h - HTML 응답에 들어 있는 같은 origin의 리소스를 미리 캐시에 받아 둔다
+ *
+ * 캐시에 들어가는 text/html 응답에서 src=/href= 링크를 찾아, 같은 host:port인 것만
+ * 대기열에 넣는다. worker 쓰레드 몇 개(-p)가 end server에서 받아 캐시에 넣으므로 브라우저의
+ * 다음 요청은 캐시 hit이 된다.
+ *
+ * 미리 받았지만 아직 아무도 쓰지 않은 객체의 크기 합은 budget을 넘지 않는다. 객체가 처음
+ * hit되면 used, 쓰이지 않은 채 evict되면 wasted로 /__stats에 보고한다. 캐시를 함께 쓰는 worker
+ * process들(proxy -m)은 prefetch_share()로 budget도 함께 쓴다.
+ */
+#ifndef __PREFETCH_H__
+#define __PREFETCH_H__
+
+#include "csapp.h"
+
+#define PREFETCH_QUEUE 32         /* 받기를 기다리는 URL 수 */
+#define PREFETCH_LINKS 16         /* 페이지 하나에서 꺼내는 링크 수 */
+#define PREFETCH_TIMEOUT_MS 5000  /* 응답 읽기 deadline */
+#define DEFAULT_PREFETCH_BUDGET (256 * 1024)
+
+/* end server(또는 reverse proxy면 backend)와 연결한다. 실패하면 음수 */
+typedef int (*prefetch_connect_t)(char *hostname, int port, char *path);
+
+/* workers가 0이면 prefetch하지 않는다 */
+void prefetch_init(int workers, size_t budget, prefetch_connect_t connect);
+
+/* 아직 쓰이지 않은 prefetch 크기를 공유 메모리(shm.h)에 센다. worker를 fork하기 전에 */
+void prefetch_share(void);
+
+/* 캐시에 넣은 응답(uri의 헤더 + 본문)이 HTML이면 링크를 찾아 대기열에 넣는다 */
+void prefetch_scan(char *uri, char *resp, size_t len);
+
+/* url("http://host[:port]/path")을 직접 대기열에 넣는다. Range 요청만 받아 간 객체를
+   뒤에서 통째로 캐시에 채울 때 쓴다 */
+void prefetch_url(char *url);
+
+/* cache.c: 미리 받은 객체가 처음 쓰였거나(used) 쓰이지 않고 빠졌을 때 */
+void prefetch_settle(size_t size, int used);
+
+#endif /* __PREFETCH_H__ */
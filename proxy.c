@@ -1,8 +1,22 @@
 #include <stdio.h>
 #include "csapp.h"
-/* Recommended max cache and object sizes */
-#define MAX_CACHE_SIZE 1049000
-#define MAX_OBJECT_SIZE 102400
+#include "relay.h"
+#include "cache.h"
+#include "stats.h"
+#include "hist.h"
+#include "log.h"
+#include "budget.h"
+#include "admit.h"
+#include "pool.h"
+#include "prefetch.h"
+#include "snapshot.h"
+#include "cachekey.h"
+#include "arena.h"
+#include "range.h"
+#include "negcache.h"
+#include "config.h"
+#include "drain.h"
+#include "shm.h"
 
 /* You won't lose style points for including this long line in your code */
 static const char *user_agent_hdr = "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:10.0.3) Gecko/20120305 Firefox/10.0.3\r\n";
@@ -16,112 +30,647 @@ static const char *connection_key = "Connection";
 static const char *user_agent_key = "User-Agent";
 static const char *proxy_connection_key = "Proxy-Connection";
 static const char *host_key = "Host";
+static const char *range_key = "Range";
+static const char *if_range_key = "If-Range";
+static const char *keep_alive_key = "Keep-Alive";
+
+/* end server로 그대로 넘기는 client header 합의 상한. 넘는 header는 버린다 */
+#define MAX_FWD_HDR (4 * MAXLINE)
 
 // commnuication from client to server
-void doit(int connfd);
+void doit(int connfd, arena_t *arena);
 // parsing the uri that client requests
 void parse_uri(char *uri, char *hostname, char *path, int *port);
-void build_http_header(char *http_header, char *hostname, char *path, int port, rio_t *client_rio);
+char *build_http_header(arena_t *arena, char *hostname, char *path, int port, rio_t *client_rio);
 // int connect_endServer(char *hostname, int port, char *http_header);
 int connect_endServer(char *hostname, int port);
+void clienterror(int fd, char *cause, char *errnum, char *shortmsg, char *longmsg);
+void host_from_header(char *http_header, char *hostname, int *port);
+char *header_value(arena_t *arena, char *http_header, const char *key);
+int prefetch_connect(char *hostname, int port, char *path);
+
+/* 연결 하나가 end server에서 읽어 쥐고 있을 수 있는 양 (-c). 커널 소켓 버퍼도 이만큼으로 묶는다 */
+static int conn_budget = DEFAULT_CONN_BUDGET;
 
-/* 쓰레드가 생성될 때 수행하게 될 함수를 선언한다. */
+/* 미리 만들어 둔 worker 쓰레드가 수행하게 될 함수를 선언한다. */
 void *thread(void *vargsp);
+void shed(int connfd);
+
+/* -m: worker process를 띄우고 지켜본다. worker에서만 돌아온다 */
+#define RESPAWN_MIN_MS 1000 /* 이보다 빨리 죽은 worker는 잠시 쉬었다가 다시 띄운다 */
+static int supervise(int procs, int forward_hup, int *respawned);
+
+static void usage(char *prog)
+{
+  fprintf(stderr, "usage :%s [-b uring|rio] [-l error|warn|info|debug] [-M bytes] [-c bytes] [-C ms] [-F ms] [-I ms] [-E ms] "
+                  "[-w workers] [-q queue] [-Q ms] [-P pool=host:port,...] [-r [host][/prefix]=pool] [-L least|p2c] "
+                  "[-H ms] [-p workers] [-B bytes] [-R] [-S file] [-T s] [-K sort|drop|strip=name,...] [-A lru|tinylfu] "
+                  "[-N status=s,...,dns=s,connect=s] [-f config] [-D ms] [-u path] [-m procs] <port> \n",
+          prog);
+  exit(1);
+}
+
+/* 실행 중에 바꿀 수 있는 옵션은 설정(config.h)의 같은 key로 넣는다 */
+static void option(config_t *c, const char *key, const char *value, char *prog)
+{
+  if (config_set(c, key, value) == 0)
+    return;
+  fprintf(stderr, "bad %s: %s\n", key, value);
+  usage(prog);
+}
 
 /*
-  main() : 클라이언트를 연결할 때마다 그 연결을 수행하는 쓰레드를 만들어준다.
+  main() : worker 쓰레드들을 미리 만들고, 클라이언트를 연결할 때마다 그 연결을 대기열에 넣는다.
 */
 int main(int argc, char **argv)
 {
-  int listenfd, p_connfd;
+  int listenfd, i;
+  conn_t conn;
   char hostname[MAXLINE], port[MAXLINE];
+  pthread_t tid;
   socklen_t clientlen;
   struct sockaddr_storage clientaddr; /*generic sockaddr struct which is 28 Bytes.The same use as sockaddr*/
 
-  if (argc != 2)
+  int opt;
+  char *backend = "uring", *conf_path = NULL, *handover_path = NULL;
+  config_t *config = config_new();
+  int workers = DEFAULT_WORKERS, queue_max = DEFAULT_QUEUE_MAX, target_ms = 0;
+  int probe_ms = DEFAULT_PROBE_MS, prefetchers = 0;
+  long prefetch_budget = DEFAULT_PREFETCH_BUDGET;
+  char *snap_path = NULL;
+  int snap_interval = 0;
+  int procs = 0, proc = 0, respawned = 0;
+
+  /* -b : 응답 중계 백엔드 (uring이 안 되는 커널이면 rio로 되돌아간다)
+     -l : 로그 레벨 (error|warn|info|debug), 실행 중에는 SIGUSR1/SIGUSR2로 조절
+     -M : 모든 연결의 중계/캐시 버퍼 메모리 합의 상한 (bytes)
+     -c : 연결 하나의 버퍼 상한 (bytes)
+     -C / -F / -I : end server connect, 첫 응답 바이트, 응답 중 idle deadline (ms, 0이면 없음)
+     -E : client가 request line과 header를 보내는 동안의 read deadline (ms, 0이면 없음). 지나면 연결을 닫는다
+     -w / -q : worker 쓰레드 수(동시 처리 한도), 대기열 길이. 넘치면 503
+     -Q : 대기열 지연 목표 (ms). 주면 동시 처리 한도를 AIMD로 조절
+     -P / -r / -L : reverse proxy 모드의 backend pool, route, 부하 분산 방식 (pool.h)
+     -H : backend active health check 간격 (ms, 0이면 요청 결과로만 판단)
+     -p / -B : HTML에 든 리소스를 미리 받는 쓰레드 수(0이면 끔), 아직 안 쓰인 prefetch의 상한 (bytes)
+     -R : 캐시에 없어 end server로 넘긴 Range 요청 뒤, 캐시할 수 있는 크기면 객체 전체를 prefetch로 채운다
+     -S / -T : 캐시 snapshot 파일(시작할 때 읽고 SIGTERM에 저장), 주기적으로 저장할 간격 (s)
+     -K : 캐시 key의 query 규칙 (parameter 정렬, query 버리기, 이름으로 빼기). 여러 번 줄 수 있다
+     -A : 캐시 admission 정책 (lru는 항상 받고, tinylfu는 자주 쓰이는 객체만 victim을 밀어낸다)
+     -N : 오류 응답(status별)과 DNS/connect 실패를 기억할 시간 (s, 0이면 끔). 기본값은 DEFAULT_NEG_SPEC
+     -f : 설정 파일. 명령줄 값을 덮어쓰고 SIGHUP을 받을 때마다 다시 읽는다 (config.h)
+     -D : SIGTERM을 받은 뒤 남은 요청을 기다리는 시간 (ms)
+     -u : listen socket을 넘겨주고 받는 Unix socket 경로. 같은 -u로 새 binary를 띄우면 교체된다 (drain.h)
+     -m : worker process 수. 주면 master가 그만큼 fork하고, worker들은 공유 메모리의 캐시 하나(cache.h)와
+          listen socket을 함께 쓴다. 죽은 worker는 다시 띄운다. -w, -q, -p는 worker마다. -u와 함께 쓸 수 없다
+     -l, -M, -C, -F, -I, -E, -D, -P, -r, -L, -R, -A, -N은 설정 파일에서도 줄 수 있다 */
+  while ((opt = getopt(argc, argv, "b:l:M:c:C:F:I:E:D:w:q:Q:P:r:L:H:p:B:RS:T:K:A:N:f:u:m:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'b':
+      backend = optarg;
+      break;
+    case 'M':
+      option(config, "mem_budget", optarg, argv[0]);
+      break;
+    case 'c':
+      conn_budget = atoi(optarg);
+      break;
+    case 'C':
+      option(config, "connect_ms", optarg, argv[0]);
+      break;
+    case 'F':
+      option(config, "first_byte_ms", optarg, argv[0]);
+      break;
+    case 'I':
+      option(config, "idle_ms", optarg, argv[0]);
+      break;
+    case 'E':
+      option(config, "header_ms", optarg, argv[0]);
+      break;
+    case 'D':
+      option(config, "drain_ms", optarg, argv[0]);
+      break;
+    case 'w':
+      workers = atoi(optarg);
+      break;
+    case 'q':
+      queue_max = atoi(optarg);
+      break;
+    case 'Q':
+      target_ms = atoi(optarg);
+      break;
+    case 'P':
+      option(config, "pool", optarg, argv[0]);
+      break;
+    case 'r':
+      option(config, "route", optarg, argv[0]);
+      break;
+    case 'H':
+      probe_ms = atoi(optarg);
+      break;
+    case 'p':
+      prefetchers = atoi(optarg);
+      break;
+    case 'B':
+      prefetch_budget = atol(optarg);
+      break;
+    case 'R':
+      option(config, "range_fill", "1", argv[0]);
+      break;
+    case 'S':
+      snap_path = optarg;
+      break;
+    case 'T':
+      snap_interval = atoi(optarg);
+      break;
+    case 'K':
+      if (cachekey_rule(optarg) == 0)
+        break;
+      fprintf(stderr, "bad cache key rule: %s\n", optarg);
+      exit(1);
+    case 'A':
+      option(config, "admission", optarg, argv[0]);
+      break;
+    case 'N':
+      option(config, "negative", optarg, argv[0]);
+      break;
+    case 'L':
+      option(config, "balance", optarg, argv[0]);
+      break;
+    case 'l':
+      option(config, "log_level", optarg, argv[0]);
+      break;
+    case 'f':
+      conf_path = optarg;
+      break;
+    case 'u':
+      handover_path = optarg;
+      break;
+    case 'm':
+      procs = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (argc - optind != 1 || conn_budget <= 0 || workers <= 0 || queue_max <= 0 || target_ms < 0 || probe_ms < 0 ||
+      prefetchers < 0 || prefetch_budget < 0 || snap_interval < 0 || procs < 0 || procs > CACHE_PROCS ||
+      (procs > 0 && handover_path != NULL))
   {
-    fprintf(stderr, "usage :%s <port> \n", argv[0]);
+    usage(argv[0]);
+  }
+  /* 쓰레드를 만들기 전에 */
+  snapshot_init(snap_path, snap_interval);
+  drain_init();
+  if (config_init(config, conf_path) < 0)
     exit(1);
+  /* 실행 중인 proxy가 있으면 listen socket을 넘겨받는다. 그쪽이 snapshot을 저장한 뒤에 돌아온다 */
+  if ((listenfd = drain_takeover(handover_path)) >= 0)
+    printf("listening socket taken over via %s\n", handover_path);
+  if (procs > 0)
+  {
+    /* worker들이 함께 쓸 것은 fork하기 전에 공유 메모리에 잡는다. 여기서부터는 worker 하나의 일 */
+    shm_init(1);
+    stats_share(procs);
+    prefetch_share();
+    cache_init();
+    listenfd = Open_listenfd(argv[optind]);
+    proc = supervise(procs, conf_path != NULL, &respawned);
+    cache_attach(proc);
+    stats_attach(proc);
   }
+  relay_init(backend, conn_budget);
+  printf("relay backend: %s\n", relay_backend_name());
+  fflush(stdout);
+  log_init(config_get()->log_level);
+  config_start();
+  if (respawned && conf_path != NULL)
+    config_reload();
+  if (procs == 0)
+    cache_init();
+  /* snapshot은 0번 worker만 읽고 쓴다 */
+  if (proc == 0)
+    snapshot_start(!respawned);
+  else
+    snapshot_disable();
+  admit_init(workers, queue_max, target_ms);
+  pool_start_probes(probe_ms, conf_path != NULL);
+  prefetch_init(prefetchers, prefetch_budget, prefetch_connect);
+
+  /* client가 먼저 끊어도 쓰레드가 아닌 프로세스 전체가 죽지 않도록 */
+  Signal(SIGPIPE, SIG_IGN);
 
   /* 해당 포트 번호에 해당하는 듣기 소켓 식별자를 열어준다. */
-  listenfd = Open_listenfd(argv[1]);
+  if (listenfd < 0)
+    listenfd = Open_listenfd(argv[optind]);
+
+  for (i = 0; i < workers; i++)
+    Pthread_create(&tid, NULL, thread, NULL);
+  drain_start(listenfd, handover_path);
 
-  /* 클라이언트의 요청이 올 때마다 새로 연결 소켓을 만들어 doit()호출 */
+  /* 클라이언트의 요청이 올 때마다 새로 연결 소켓을 만들어 대기열에 넣으면 worker가 doit()호출 */
   while (1)
   {
     clientlen = sizeof(clientaddr);
-    /* 클라이언트에게서 받은 연결 요청을 accept한다. p_connfd = proxy의 connfd*/
-    p_connfd = Accept(listenfd, (SA *)&clientaddr, &clientlen);
+    /* 클라이언트에게서 받은 연결 요청을 accept한다. p_connfd = proxy의 connfd. drain이 시작되면 -1 */
+    if ((conn.connfd = relay_accept(listenfd, (SA *)&clientaddr, &clientlen)) < 0)
+      break;
+    conn.accepted = hist_now();
+    /* main 쓰레드도 옛 설정을 붙들고 있지 않도록 */
+    config_refresh();
 
     /* 연결이 성공했다는 메세지를 위해. Getnameinfo를 호출하면서 hostname과 port가 채워진다.*/
-    Getnameinfo((SA *)&clientaddr, clientlen, hostname, MAXLINE, port, MAXLINE, 0);
-    printf("Accepted connection from (%s %s).\n", hostname, port);
-    doit(p_connfd);
-    Close(p_connfd);
+    /* 로그를 남기지 않을 때는 이름 변환도 하지 않는다 */
+    if (LOG_INFO <= log_level)
+    {
+      Getnameinfo((SA *)&clientaddr, clientlen, hostname, MAXLINE, port, MAXLINE, 0);
+      LOGF(LOG_INFO, "Accepted connection from (%s %ld).", hostname, atol(port));
+    }
+    /* 처리할 여력도, 기다릴 자리도 없으면 붙잡아 두지 않고 바로 돌려보낸다 */
+    if (!admit_offer(&conn))
+    {
+      shed(conn.connfd);
+      Close(conn.connfd);
+    }
+  }
+  /* 넘겨줬으면 새 process가 같은 socket으로 계속 받는다. 남은 요청이 끝나면 drain이 process를 끝낸다 */
+  Close(listenfd);
+  drain_accept_stopped();
+  pthread_exit(NULL);
+}
+
+void *thread(void *vargsp)
+{
+  conn_t conn;
+  long long start;
+  arena_t arena;
+
+  /* 따로 join하지 않으므로 종료 시 자원이 바로 회수되도록 */
+  Pthread_detach(pthread_self());
+  /* 요청마다 쓰는 문자열과 rio 버퍼. 요청이 끝나면 비우고 다음 요청에 다시 쓴다 */
+  arena_init(&arena, ARENA_BLOCK);
+  while (1)
+  {
+    admit_take(&conn);
+    /* 요청 하나는 처음부터 끝까지 같은 설정으로 처리한다 */
+    config_refresh();
+    start = hist_now();
+    hist_record(PHASE_ACCEPT_WAIT, start - conn.accepted);
+    /* 느린 client 쪽 커널 송신 버퍼도 연결 예산만큼만 */
+    setsockopt(conn.connfd, SOL_SOCKET, SO_SNDBUF, &conn_budget, sizeof(conn_budget));
+    stats_inc(STAT_ACTIVE_CONNS);
+    doit(conn.connfd, &arena);
+    arena_reset(&arena);
+    stats_add(STAT_ACTIVE_CONNS, -1);
+    hist_record(PHASE_TOTAL, hist_now() - start);
+    Close(conn.connfd);
+    admit_done();
+  }
+  return NULL;
+}
+
+/* proc번 worker를 fork한다. 자식은 master가 막아 둔 signal을 원래대로 돌리고 0을 받는다 */
+static pid_t spawn(int proc, sigset_t *oldmask)
+{
+  pid_t pid;
+
+  fflush(stdout);
+  if ((pid = Fork()) == 0)
+  {
+    pthread_sigmask(SIG_SETMASK, oldmask, NULL);
+    return 0;
+  }
+  printf("worker %d: pid %d\n", proc, (int)pid);
+  fflush(stdout);
+  return pid;
+}
+
+/* master: 쓰레드 없이 signal만 기다린다. worker가 끝나면 그 worker가 빌려간 캐시 객체와 게이지를
+   정리하고, 종료 중이 아니면 같은 번호로 다시 띄운다. SIGTERM, SIGUSR1/2와 (설정 파일이 있으면) SIGHUP은
+   모든 worker에게 넘긴다. SIGTERM을 받으면 worker들이 drain하고 모두 끝날 때 종료한다 */
+static int supervise(int procs, int forward_hup, int *respawned)
+{
+  pid_t pids[CACHE_PROCS], pid;
+  long long started[CACHE_PROCS];
+  sigset_t set, oldmask;
+  siginfo_t info;
+  int i, status, live = 0, stopping = 0;
+
+  sigemptyset(&set);
+  sigaddset(&set, SIGTERM);
+  sigaddset(&set, SIGHUP);
+  sigaddset(&set, SIGUSR1);
+  sigaddset(&set, SIGUSR2);
+  sigaddset(&set, SIGCHLD);
+  pthread_sigmask(SIG_BLOCK, &set, &oldmask);
+  for (i = 0; i < procs; i++)
+  {
+    started[i] = hist_now();
+    if ((pids[i] = spawn(i, &oldmask)) == 0)
+      return i;
+    live++;
+  }
+
+  while (live > 0)
+  {
+    if (sigwaitinfo(&set, &info) < 0)
+      continue;
+    if (info.si_signo != SIGCHLD)
+    {
+      if (info.si_signo == SIGTERM)
+        stopping = 1;
+      if (info.si_signo == SIGHUP && !forward_hup)
+        continue;
+      for (i = 0; i < procs; i++)
+        if (pids[i] > 0)
+          kill(pids[i], info.si_signo);
+      continue;
+    }
+    /* SIGCHLD는 여러 번 와도 한 번으로 합쳐질 수 있다 */
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+    {
+      for (i = 0; i < procs && pids[i] != pid; i++)
+        ;
+      if (i == procs)
+        continue;
+      pids[i] = 0;
+      live--;
+      cache_reap(i);
+      stats_forget(i);
+      if (WIFSIGNALED(status))
+        printf("worker %d: pid %d killed by signal %d\n", i, (int)pid, WTERMSIG(status));
+      else
+        printf("worker %d: pid %d exited with status %d\n", i, (int)pid, WEXITSTATUS(status));
+      if (stopping)
+        continue;
+      /* 시작하자마자 죽는 worker를 쉬지 않고 다시 띄우지 않도록 */
+      if (hist_now() - started[i] < RESPAWN_MIN_MS * 1000000LL)
+        sleep(1);
+      started[i] = hist_now();
+      if ((pids[i] = spawn(i, &oldmask)) == 0)
+      {
+        *respawned = 1;
+        return i;
+      }
+      live++;
+    }
   }
-  return 0;
+  printf("master: all workers exited\n");
+  exit(0);
 }
 
-void doit(int connfd)
+/* 과부하 응답. main 쓰레드에서 부르므로 request는 읽지 않고, 이미 도착한 만큼만 버린다
+   (읽지 않은 데이터가 남은 채 close하면 RST가 가서 client가 503을 못 볼 수 있다) */
+void shed(int connfd)
+{
+  static const char *resp = "HTTP/1.0 503 Service Unavailable\r\n"
+                            "Retry-After: 1\r\n"
+                            "Content-length: 0\r\n"
+                            "Connection: close\r\n\r\n";
+  char buf[MAXLINE];
+
+  while (recv(connfd, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+    ;
+  send(connfd, resp, strlen(resp), MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+/* 요청 중에 쓰는 문자열은 모두 arena에서 실제 길이만큼 잡는다. 비우는 것은 호출한 쪽 */
+void doit(int connfd, arena_t *arena)
 {
   // proxy 뒤에 존재하는 end server
   int end_serverfd;
   int port;
 
-  char buf[MAXLINE], method[MAXLINE], uri[MAXLINE], version[MAXLINE];
-  char endserver_http_header[MAXLINE];
-  char hostname[MAXLINE], path[MAXLINE];
-  /*rio is client's rio,server_rio is endserver's rio*/
-  rio_t rio, server_rio;
+  char *buf, *method, *uri, *version;
+  char *endserver_http_header;
+  char *hostname, *path, *key, *range, *if_range, *url;
+  size_t len, keycap;
+  ssize_t sent;
+  long total;
+  /*rio is client's rio*/
+  rio_t *rio = arena_alloc(arena, sizeof(rio_t));
+  cache_obj_t *obj;
+  cache_fill_t fill;
+  size_t n;
+  pool_t *pool;
+  int origin_form, cacheable;
+  backend_t *backend = NULL;
+  long long t = hist_now();
+  int header_ms = config_get()->header_ms;
+  struct timeval tv, notv = {0, 0};
 
-  Rio_readinitb(&rio, connfd);
-  // read the client's rio into buffer
-  Rio_readlineb(&rio, buf, MAXLINE);
+  Rio_readinitb(rio, connfd);
+  // 연결만 하고 요청을 보내지 않는 client가 worker를 쥐고 있지 못하게, header를 다 읽을 때까지 read deadline을 건다
+  if (header_ms > 0)
+  {
+    tv.tv_sec = header_ms / 1000;
+    tv.tv_usec = (header_ms % 1000) * 1000;
+    setsockopt(connfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  }
+  // read the client's rio into buffer. request line을 기다리는 동안은 drain이 닫을 수 있다
+  drain_idle_begin(connfd);
+  errno = 0;
+  buf = arena_readline(arena, rio);
+  drain_idle_end(connfd);
+  if (buf == NULL)
+  {
+    if (errno == EAGAIN)
+      LOGF(LOG_DEBUG, "client sent no request line in %ld ms", NULL, (long)header_ms);
+    return;
+  }
+  len = strlen(buf) + 1;
+  method = arena_alloc(arena, len);
+  uri = arena_alloc(arena, len);
+  version = arena_alloc(arena, len);
+  method[0] = uri[0] = version[0] = '\0';
   sscanf(buf, "%s %s %s", method, uri, version);
+  stats_inc(STAT_REQUESTS);
   // request의 method가 GET이 아니면 error 처리
   if (strcasecmp(method, "GET"))
   {
-    printf("Proxy does not implement the method");
+    LOGF(LOG_WARN, "Proxy does not implement the method %s", method);
+    stats_inc(STAT_ERRORS);
     return;
   }
 
-  parse_uri(uri, hostname, path, &port);
+  // hostname과 path는 uri보다 길어질 수 없다 (path는 기본값 "/" 자리까지)
+  hostname = arena_alloc(arena, len);
+  path = arena_alloc(arena, len + 1);
+  // reverse proxy로 받은 origin-form("GET /path")이면 host는 Host header에서 얻는다
+  if ((origin_form = uri[0] == '/'))
+  {
+    hostname[0] = '\0';
+    strcpy(path, uri);
+    port = 80;
+  }
+  else
+  {
+    // "http://host:port"처럼 path가 없으면 parse_uri가 채우지 않는다
+    strcpy(path, "/");
+    parse_uri(uri, hostname, path, &port);
+  }
   /*build the http header which will send to the end server*/
-  build_http_header(endserver_http_header, hostname, path, port, &rio);
+  endserver_http_header = build_http_header(arena, hostname, path, port, rio);
+  if (endserver_http_header == NULL)
+  {
+    LOGF(LOG_DEBUG, "client sent no end of headers in %ld ms", NULL, (long)header_ms);
+    stats_inc(STAT_ERRORS);
+    return;
+  }
+  if (header_ms > 0)
+    setsockopt(connfd, SOL_SOCKET, SO_RCVTIMEO, &notv, sizeof(notv));
+  if (hostname[0] == '\0')
+  {
+    hostname = arena_alloc(arena, strlen(endserver_http_header) + 1);
+    host_from_header(endserver_http_header, hostname, &port);
+  }
+  range = header_value(arena, endserver_http_header, range_key);
+  if_range = range ? header_value(arena, endserver_http_header, if_range_key) : NULL;
+  hist_record(PHASE_PARSE, hist_now() - t);
+
+  /* http://proxy.local/__stats 는 proxy가 직접 응답 */
+  if (!strcasecmp(hostname, STATS_HOST) && !strncmp(path, STATS_PATH, strlen(STATS_PATH)))
+  {
+    stats_serve(connfd, strchr(path, '?'));
+    return;
+  }
+
+  /* 캐시에 있으면 end server에 가지 않고 바로 응답. key가 너무 길면 캐시를 쓰지 않는다 */
+  t = hist_now();
+  keycap = strlen(hostname) + strlen(path) + 32; /* "http://", ":port" 자리 */
+  key = arena_alloc(arena, keycap);
+  cacheable = cachekey_build(hostname, port, path, key, keycap) == 0;
+  obj = cacheable ? cache_lookup(key, endserver_http_header) : NULL;
+  hist_record(PHASE_CACHE_LOOKUP, hist_now() - t);
+  if (obj != NULL)
+  {
+    /* Range 요청이면 캐시된 전체 응답에서 필요한 구간만 보낸다 */
+    if (cache_status(obj->data, obj->size) != 200)
+      stats_inc(STAT_NEG_HITS);
+    if (range != NULL && (sent = range_serve(arena, connfd, obj->data, obj->size, range, if_range)) >= 0)
+      stats_inc(STAT_RANGE_HITS);
+    else
+    {
+      Rio_writen(connfd, obj->data, obj->size);
+      sent = obj->size;
+    }
+    stats_add(STAT_BYTES_OUT, sent);
+    cache_release(obj);
+    return;
+  }
+
+  /* reverse proxy 모드: route에 맞는 pool에서 backend를 고른다 */
+  if (pool_enabled() && (pool = pool_route(hostname, path)) != NULL)
+    backend = pool_acquire(pool);
+  else if (origin_form)
+  {
+    /* 갈 곳을 모르는 origin-form은 forward proxy로도 처리할 수 없다 */
+    LOGF(LOG_WARN, "no route for %s", hostname);
+    stats_inc(STAT_ERRORS);
+    clienterror(connfd, hostname, "502", "Bad Gateway", "No backend pool for this host");
+    return;
+  }
 
   /*connect to the end server*/
   // end_serverfd = connect_endServer(hostname, port, endserver_http_header);
-  end_serverfd = connect_endServer(hostname, port);
+  end_serverfd = backend ? connect_endServer(backend->host, backend->port) : connect_endServer(hostname, port);
   if (end_serverfd < 0)
   {
-    printf("connection failed\n");
+    if (backend)
+    {
+      pool_report_result(backend, 0);
+      pool_release(backend);
+    }
+    LOGF(LOG_WARN, "connection failed: %s:%ld", hostname, port);
+    stats_inc(STAT_ERRORS);
+    if (errno == ETIMEDOUT)
+    {
+      stats_inc(STAT_UPSTREAM_TIMEOUTS);
+      clienterror(connfd, hostname, "504", "Gateway Timeout", "Proxy could not connect to the end server in time");
+    }
+    else
+      clienterror(connfd, hostname, "502", "Bad Gateway", "Proxy could not connect to the end server");
     return;
   }
+  stats_inc(STAT_UPSTREAM_CONNECTS);
 
-  Rio_readinitb(&server_rio, end_serverfd);
-  /*write the http header to endserver*/
-  Rio_writen(end_serverfd, endserver_http_header, strlen(endserver_http_header));
-
-  /*receive message from end server and send to the client*/
-  size_t n;
-  while ((n = Rio_readlineb(&server_rio, buf, MAXLINE)) != 0)
+  /*send the http header to endserver and relay its response to the client*/
+  cache_fill_init(&fill);
+  if (relay_transfer(end_serverfd, connfd, endserver_http_header, strlen(endserver_http_header), cache_fill, &fill, &n) < 0)
   {
-    printf("proxy received %ld bytes,then send\n", n);
-    Rio_writen(connfd, buf, n);
+    LOGF(LOG_WARN, "relay failed: %s", strerror(errno));
+    stats_inc(STAT_ERRORS);
+    stats_add(STAT_BYTES_OUT, n);
+    if (errno == ETIMEDOUT)
+      stats_inc(STAT_UPSTREAM_TIMEOUTS);
+    /* 아직 client에게 아무것도 보내지 않았을 때만 proxy가 대신 응답할 수 있다 */
+    if (n == 0)
+    {
+      if (errno == ETIMEDOUT)
+        clienterror(connfd, hostname, "504", "Gateway Timeout", "End server did not respond in time");
+      else
+        clienterror(connfd, hostname, "502", "Bad Gateway", "End server closed the connection");
+    }
   }
+  else
+  {
+    stats_add(STAT_BYTES_IN, n);
+    stats_add(STAT_BYTES_OUT, n);
+    /* 캐시할 수 있는 응답(200이나 negative TTL이 있는 오류)을 끝까지 받았고 max_object_size 이하일 때만 캐시.
+       오류 본문의 링크는 미리 받지 않는다 */
+    if (cacheable && cache_fill_ok(&fill))
+    {
+      cache_insert(key, endserver_http_header, fill.buf, fill.len, 0);
+      if (cache_status(fill.buf, fill.len) == 200)
+        prefetch_scan(key, fill.buf, fill.len);
+    }
+    /* 부분(206) 응답은 캐시하지 않는다. 전체가 캐시할 만한 크기면 뒤에서 통째로 받아 둔다 */
+    else if (config_get()->range_fill && cacheable && (total = range_total(fill.buf, fill.len)) > 0 &&
+             total <= config_get()->max_object)
+    {
+      url = arena_alloc(arena, strlen(hostname) + strlen(path) + 32);
+      sprintf(url, "http://%s:%d%s", hostname, port, path);
+      prefetch_url(url);
+    }
+  }
+  cache_fill_free(&fill);
   Close(end_serverfd);
+  if (backend)
+  {
+    /* 응답을 하나도 못 받았을 때만 backend 탓으로 센다. 도중에 끊긴 건 client 탓일 수도 있다 */
+    pool_report_result(backend, n > 0);
+    pool_release(backend);
+  }
 }
 
-// http_header 인자에 만들어서 반환
-void build_http_header(char *http_header, char *hostname, char *path, int port, rio_t *client_rio)
+/* end server에 보낼 header를 arena에 만들어 반환한다. client가 header_ms 안에 header를 다 보내지 않으면 NULL */
+typedef struct hdr_line
 {
-  char buf[MAXLINE], request_hdr[MAXLINE], other_hdr[MAXLINE], host_hdr[MAXLINE];
+  char *line;
+  struct hdr_line *next;
+} hdr_line_t;
+
+/* line이 key header인지 (이름 뒤에 바로 ':') */
+static int is_header(char *line, const char *key)
+{
+  return !strncasecmp(line, key, strlen(key)) && line[strlen(key)] == ':';
+}
+
+char *build_http_header(arena_t *arena, char *hostname, char *path, int port, rio_t *client_rio)
+{
+  char *buf, *request_hdr, *host_hdr = NULL, *http_header, *p;
+  hdr_line_t *other_hdr = NULL, **tailp = &other_hdr, *h;
+  size_t len, fwd = 0;
+  int client_ua = 0;
+
   // request_hdr에 reqquestlint_hdr_format을 담음(path인자는 reqquestlint_hdr_format에 들어갈 값)
   // path는 request source 경로
+  request_hdr = arena_alloc(arena, strlen(requestlint_hdr_format) + strlen(path));
   sprintf(request_hdr, requestlint_hdr_format, path);
   /*get other request header for client rio and change it */
-  while (Rio_readlineb(client_rio, buf, MAXLINE) > 0)
+  errno = 0;
+  while ((buf = arena_readline(arena, client_rio)) != NULL)
   {
     // 읽어들인 값(buf)가 /r/n이면 break
     if (strcmp(buf, endof_hdr) == 0)
@@ -129,40 +678,210 @@ void build_http_header(char *http_header, char *hostname, char *path, int port,
       break;
     }
 
-    // host header값 만들어주기
-    if (!strncasecmp(buf, host_key, strlen(host_key))) /*Host:*/
+    // host header값 만들어주기 (두 번째부터는 버린다)
+    if (is_header(buf, host_key)) /*Host:*/
     {
-      // buf를 host_hdr에서 지정한 위치로 복사
-      strcpy(host_hdr, buf);
+      if (host_hdr == NULL)
+        host_hdr = buf;
+      else
+        arena_trim(arena, buf, 0);
       continue;
     }
 
-    // host header 이외의 header 만들어주기
-    if (!strncasecmp(buf, connection_key, strlen(connection_key)) && !strncasecmp(buf, proxy_connection_key, strlen(proxy_connection_key)) && !strncasecmp(buf, user_agent_key, strlen(user_agent_key)))
+    // 연결 관리 header는 proxy가 새로 쓴다. 남기지 않는 줄은 arena에 쌓지 않는다
+    if (is_header(buf, connection_key) || is_header(buf, proxy_connection_key) || is_header(buf, keep_alive_key) ||
+        fwd + strlen(buf) > MAX_FWD_HDR)
     {
-      strcat(other_hdr, buf);
+      arena_trim(arena, buf, 0);
+      continue;
     }
+
+    // 나머지(Range, Accept-Encoding, client의 User-Agent 등)는 그대로 넘긴다.
+    // 응답이 Vary로 이 값들에 따라 달라지면 캐시도 값마다 따로 둔다 (cache.h)
+    if (is_header(buf, user_agent_key))
+      client_ua = 1;
+    fwd += strlen(buf);
+    h = arena_alloc(arena, sizeof(hdr_line_t));
+    h->line = buf;
+    h->next = NULL;
+    *tailp = h;
+    tailp = &h->next;
   }
+  // EOF는 header의 끝으로 보지만 deadline(SO_RCVTIMEO)이 지난 것이면 요청을 버린다
+  if (buf == NULL && errno == EAGAIN)
+    return NULL;
 
   // request header에 host header가 없다면 hostname으로 만들어주기
-  if (strlen(host_hdr) == 0)
+  if (host_hdr == NULL)
   {
+    host_hdr = arena_alloc(arena, strlen(host_hdr_format) + strlen(hostname));
     sprintf(host_hdr, host_hdr_format, hostname);
   }
-  // 완전체 만들어주기
-  sprintf(http_header, "%s%s%s%s%s%s%s", request_hdr, host_hdr, conn_hdr, prox_hdr, user_agent_hdr, other_hdr, endof_hdr);
-  return;
+  // 완전체 만들어주기. User-Agent는 client가 보내지 않았을 때만 기본값을 쓴다
+  len = strlen(request_hdr) + strlen(host_hdr) + strlen(conn_hdr) + strlen(prox_hdr) + strlen(user_agent_hdr) + strlen(endof_hdr) + 1;
+  for (h = other_hdr; h != NULL; h = h->next)
+    len += strlen(h->line);
+  p = http_header = arena_alloc(arena, len);
+  p = stpcpy(p, request_hdr);
+  p = stpcpy(p, host_hdr);
+  p = stpcpy(p, conn_hdr);
+  p = stpcpy(p, prox_hdr);
+  if (!client_ua)
+    p = stpcpy(p, user_agent_hdr);
+  for (h = other_hdr; h != NULL; h = h->next)
+    p = stpcpy(p, h->line);
+  stpcpy(p, endof_hdr);
+  return http_header;
+}
+
+/* prefetch worker의 upstream 연결. 요청과 같은 규칙으로 backend를 고른다 */
+int prefetch_connect(char *hostname, int port, char *path)
+{
+  pool_t *pool;
+  backend_t *backend;
+  int fd;
+
+  if (!pool_enabled() || (pool = pool_route(hostname, path)) == NULL)
+    return connect_endServer(hostname, port);
+  backend = pool_acquire(pool);
+  fd = connect_endServer(backend->host, backend->port);
+  if (fd < 0)
+    pool_report_result(backend, 0);
+  /* 백그라운드 요청이라 outstanding에는 연결할 때만 잡힌다 */
+  pool_release(backend);
+  return fd;
+}
+
+/* end server용 header의 Host 값에서 이름을 hostname에, ":port"가 있으면 그 포트를 port에 담는다.
+   Host header가 없으면 hostname은 빈 문자열이고 port는 그대로 */
+void host_from_header(char *http_header, char *hostname, int *port)
+{
+  char *line = http_header;
+  int p;
+
+  hostname[0] = '\0';
+  while (line != NULL && *line)
+  {
+    if (!strncasecmp(line, host_key, strlen(host_key)) && line[strlen(host_key)] == ':')
+    {
+      if (sscanf(line + strlen(host_key) + 1, " %[^:\r\n ]:%d", hostname, &p) == 2 && p > 0 && p <= 65535)
+        *port = p;
+      return;
+    }
+    if ((line = strstr(line, "\r\n")) != NULL)
+      line += 2;
+  }
+}
+
+/* http_header에서 key header의 값(앞 공백과 줄 끝 제외)을 arena에 복사해 돌려준다. 없으면 NULL */
+char *header_value(arena_t *arena, char *http_header, const char *key)
+{
+  char *line = http_header, *v;
+  size_t n;
+
+  while (line != NULL && *line)
+  {
+    if (!strncasecmp(line, key, strlen(key)) && line[strlen(key)] == ':')
+    {
+      for (v = line + strlen(key) + 1; *v == ' '; v++)
+        ;
+      n = strcspn(v, "\r\n");
+      v = memcpy(arena_alloc(arena, n + 1), v, n);
+      v[n] = '\0';
+      return v;
+    }
+    if ((line = strstr(line, "\r\n")) != NULL)
+      line += 2;
+  }
+  return NULL;
+}
+
+/* proxy 자신이 만든 오류 응답을 client에게 보낸다 (tiny의 clienterror와 같은 모양) */
+void clienterror(int fd, char *cause, char *errnum, char *shortmsg, char *longmsg)
+{
+  char buf[MAXLINE], body[MAXBUF];
+
+  /* Build the HTTP response body */
+  sprintf(body, "<html><title>Proxy Error</title>");
+  sprintf(body + strlen(body), "<body bgcolor=\"ffffff\">\r\n");
+  sprintf(body + strlen(body), "%s: %s\r\n", errnum, shortmsg);
+  sprintf(body + strlen(body), "<p>%s: %s\r\n", longmsg, cause);
+  sprintf(body + strlen(body), "<hr><em>The Proxy server</em>\r\n");
+
+  /* Print the HTTP response */
+  sprintf(buf, "HTTP/1.0 %s %s\r\n", errnum, shortmsg);
+  sprintf(buf + strlen(buf), "Content-type: text/html\r\n");
+  sprintf(buf + strlen(buf), "Content-length: %d\r\n\r\n", (int)strlen(body));
+  Rio_writen(fd, buf, strlen(buf));
+  Rio_writen(fd, body, strlen(body));
 }
 
 /*Connect to the end server*/
 // inline int connect_endServer(char *hostname, int port, char *http_header){
-inline int connect_endServer(char *hostname, int port)
+// open_clientfd()와 같지만 DNS와 connect 시간을 따로 재고, 실패해도 프로세스를 종료하지 않는다
+int connect_endServer(char *hostname, int port)
 {
   char portStr[100];
+  struct addrinfo hints, *listp, *p;
+  int clientfd = -1, rc;
+  long long t;
+  struct timeval tv, notv = {0, 0};
+
+  // 얼마 전에 실패한 host:port면 다시 시도하지 않는다
+  if ((rc = negcache_check(hostname, port)) != 0)
+  {
+    stats_inc(STAT_NEG_HITS);
+    errno = rc;
+    return rc == EHOSTUNREACH ? -2 : -1;
+  }
+
   // portstr에 port 넣어주기
   sprintf(portStr, "%d", port);
+  memset(&hints, 0, sizeof(struct addrinfo));
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG;
+
+  t = hist_now();
+  stats_inc(STAT_DNS_LOOKUPS);
+  rc = getaddrinfo(hostname, portStr, &hints, &listp);
+  hist_record(PHASE_DNS, hist_now() - t);
+  if (rc != 0)
+  {
+    LOGF(LOG_WARN, "getaddrinfo failed (%s:%ld)", hostname, port);
+    negcache_fail(hostname, port, EHOSTUNREACH, 1);
+    errno = EHOSTUNREACH;
+    return -2;
+  }
+
   // 해당 hostname과 portStr로 end_server에게 가는 요청만들어주기
-  return Open_clientfd(hostname, portStr);
+  tv.tv_sec = config_get()->connect_ms / 1000;
+  tv.tv_usec = (config_get()->connect_ms % 1000) * 1000;
+  t = hist_now();
+  for (p = listp; p; p = p->ai_next)
+  {
+    if ((clientfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) < 0)
+      continue;
+    // client가 느리면 end server 쪽 커널 수신 버퍼에도 쌓이므로 연결 예산만큼으로 묶는다 (connect 전에 해야 window에 반영)
+    setsockopt(clientfd, SOL_SOCKET, SO_RCVBUF, &conn_budget, sizeof(conn_budget));
+    // blocking connect도 SO_SNDTIMEO를 따른다. 시간이 지나면 EINPROGRESS로 실패
+    setsockopt(clientfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    if (connect(clientfd, p->ai_addr, p->ai_addrlen) != -1)
+    {
+      setsockopt(clientfd, SOL_SOCKET, SO_SNDTIMEO, &notv, sizeof(notv));
+      break;
+    }
+    rc = errno == EINPROGRESS ? ETIMEDOUT : errno;
+    close(clientfd);
+    clientfd = -1;
+  }
+  hist_record(PHASE_CONNECT, hist_now() - t);
+  freeaddrinfo(listp);
+  if (clientfd < 0)
+  {
+    negcache_fail(hostname, port, rc, 0);
+    errno = rc;
+  }
+  return clientfd;
 }
 
 /*parse the uri to get hostname,file path ,port*/
@@ -180,6 +899,8 @@ void parse_uri(char *uri, char *hostname, char *path, int *port)
     *pos2 = '\0';
     sscanf(pos, "%s", hostname);
     sscanf(pos2 + 1, "%d%s", port, path);
+    // 호출한 쪽의 uri를 망가뜨리지 않도록 원래대로 돌려놓는다
+    *pos2 = ':';
   }
   else
   {
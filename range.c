@@ -0,0 +1,203 @@
+/*
+ * range.c - 캐시된 응답에서 Range 요청에 답한다
+ */
+#include "csapp.h"
+#include "range.h"
+
+typedef struct
+{
+  long first, last;
+} byterange_t;
+
+/* 헤더 끝("\r\n\r\n" 다음, 본문 시작). 없으면 NULL */
+static char *body_of(char *resp, size_t size)
+{
+  char *p, *end = resp + size;
+
+  for (p = resp; p + 4 <= end; p++)
+    if (!memcmp(p, "\r\n\r\n", 4))
+      return p + 4;
+  return NULL;
+}
+
+/* 헤더 [resp, body)에서 name의 값 시작. *n에 값 길이. 없으면 NULL */
+static char *field(char *resp, char *body, const char *name, size_t *n)
+{
+  size_t len = strlen(name);
+  char *p, *v;
+
+  for (p = resp; p + len + 3 <= body; p++)
+    if (p[0] == '\r' && p[1] == '\n' && !strncasecmp(p + 2, name, len) && p[len + 2] == ':')
+    {
+      for (v = p + len + 3; v < body && *v == ' '; v++)
+        ;
+      for (*n = 0; v + *n < body && v[*n] != '\r'; (*n)++)
+        ;
+      return v;
+    }
+  return NULL;
+}
+
+/* If-Range가 강한 ETag("...")이면 ETag과, 아니면 Last-Modified와 글자 그대로 같아야 한다 */
+static int validator_match(char *resp, char *body, char *if_range)
+{
+  char *v;
+  size_t n;
+
+  if (!strncmp(if_range, "W/", 2))
+    return 0;
+  v = field(resp, body, if_range[0] == '"' ? "ETag" : "Last-Modified", &n);
+  return v != NULL && n == strlen(if_range) && !memcmp(v, if_range, n);
+}
+
+/* spec을 본문 길이 len 기준으로 풀어 r에 담는다. 만족하는 구간 수를 돌려주고,
+   문법이 틀렸거나 구간이 너무 많으면 -1 (Range를 무시한다) */
+static int parse_ranges(char *spec, long len, byterange_t *r)
+{
+  char *p = spec, *end;
+  long a, b;
+  int n = 0;
+
+  if (strncasecmp(p, "bytes=", 6))
+    return -1;
+  for (p += 6;; p++)
+  {
+    while (*p == ' ')
+      p++;
+    if (*p == '-')
+    {
+      /* 마지막 b 바이트 */
+      if (!isdigit((unsigned char)p[1]))
+        return -1;
+      b = strtol(p + 1, &end, 10);
+      a = b >= len ? 0 : len - b;
+      b = b > 0 ? len - 1 : -1;
+    }
+    else
+    {
+      if (!isdigit((unsigned char)*p))
+        return -1;
+      a = strtol(p, &end, 10);
+      if (*end++ != '-')
+        return -1;
+      if (isdigit((unsigned char)*end))
+      {
+        b = strtol(end, &end, 10);
+        if (b < a)
+          return -1;
+      }
+      else
+        b = len - 1;
+      if (b >= len)
+        b = len - 1;
+    }
+    if (a <= b && a < len)
+    {
+      if (n == RANGE_MAX)
+        return -1;
+      r[n].first = a;
+      r[n++].last = b;
+    }
+    for (p = end; *p == ' '; p++)
+      ;
+    if (*p == '\0')
+      return n;
+    if (*p != ',')
+      return -1;
+  }
+}
+
+/* 상태 줄과 skip으로 시작하는 줄(들)을 뺀 캐시 응답 헤더 줄들을 out에 이어 붙인다 */
+static char *copy_headers(char *out, char *resp, char *body, int multi)
+{
+  char *line, *next;
+
+  for (line = strstr(resp, "\r\n") + 2; line < body - 2; line = next)
+  {
+    next = strstr(line, "\r\n") + 2;
+    if (!strncasecmp(line, "Content-length:", 15) || (multi && !strncasecmp(line, "Content-type:", 13)))
+      continue;
+    memcpy(out, line, next - line);
+    out += next - line;
+  }
+  return out;
+}
+
+ssize_t range_serve(arena_t *arena, int fd, char *resp, size_t size, char *range, char *if_range)
+{
+  byterange_t r[RANGE_MAX];
+  char *body, *hdr, *p, *ctype, **parts;
+  size_t hdrlen, n, total;
+  long len;
+  int nr, i;
+
+  if (size < 12 || strncmp(resp + 9, "200", 3) || (body = body_of(resp, size)) == NULL)
+    return -1;
+  if (if_range != NULL && !validator_match(resp, body, if_range))
+    return -1;
+  len = resp + size - body;
+  if ((nr = parse_ranges(range, len, r)) < 0)
+    return -1;
+
+  hdrlen = body - resp;
+  hdr = p = arena_alloc(arena, hdrlen + 256);
+  if (nr == 0)
+  {
+    p += sprintf(p, "HTTP/1.0 416 Range Not Satisfiable\r\nContent-Range: bytes */%ld\r\n"
+                    "Content-length: 0\r\nConnection: close\r\n\r\n",
+                 len);
+    Rio_writen(fd, hdr, p - hdr);
+    return p - hdr;
+  }
+
+  p += sprintf(p, "HTTP/1.0 206 Partial Content\r\n");
+  p = copy_headers(p, resp, body, nr > 1);
+  if (nr == 1)
+  {
+    n = r[0].last - r[0].first + 1;
+    p += sprintf(p, "Content-Range: bytes %ld-%ld/%ld\r\nContent-length: %lu\r\n\r\n",
+                 r[0].first, r[0].last, len, (unsigned long)n);
+    Rio_writen(fd, hdr, p - hdr);
+    Rio_writen(fd, body + r[0].first, n);
+    return p - hdr + n;
+  }
+
+  /* 구간마다 part 헤더를 먼저 만들어 Content-length를 정확히 센다 */
+  ctype = field(resp, body, "Content-type", &n);
+  parts = arena_alloc(arena, nr * sizeof(char *));
+  total = strlen("\r\n--" RANGE_BOUNDARY "--\r\n");
+  for (i = 0; i < nr; i++)
+  {
+    parts[i] = arena_alloc(arena, (ctype ? n : 0) + 128);
+    if (ctype)
+      sprintf(parts[i], "\r\n--%s\r\nContent-type: %.*s\r\nContent-Range: bytes %ld-%ld/%ld\r\n\r\n",
+              RANGE_BOUNDARY, (int)n, ctype, r[i].first, r[i].last, len);
+    else
+      sprintf(parts[i], "\r\n--%s\r\nContent-Range: bytes %ld-%ld/%ld\r\n\r\n",
+              RANGE_BOUNDARY, r[i].first, r[i].last, len);
+    total += strlen(parts[i]) + r[i].last - r[i].first + 1;
+  }
+  p += sprintf(p, "Content-type: multipart/byteranges; boundary=%s\r\nContent-length: %lu\r\n\r\n",
+               RANGE_BOUNDARY, (unsigned long)total);
+  Rio_writen(fd, hdr, p - hdr);
+  for (i = 0; i < nr; i++)
+  {
+    Rio_writen(fd, parts[i], strlen(parts[i]));
+    Rio_writen(fd, body + r[i].first, r[i].last - r[i].first + 1);
+  }
+  Rio_writen(fd, "\r\n--" RANGE_BOUNDARY "--\r\n", strlen("\r\n--" RANGE_BOUNDARY "--\r\n"));
+  return p - hdr + total;
+}
+
+long range_total(char *resp, size_t len)
+{
+  char *body, *v, *slash;
+  size_t n;
+
+  if (resp == NULL || len < 12 || strncmp(resp + 9, "206", 3) || (body = body_of(resp, len)) == NULL)
+    return -1;
+  if ((v = field(resp, body, "Content-Range", &n)) == NULL || (slash = memchr(v, '/', n)) == NULL ||
+      !isdigit((unsigned char)slash[1]))
+    return -1;
+  return strtol(slash + 1, NULL, 10);
+}
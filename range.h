@@ -0,0 +1,25 @@
+/*
+ * range.h - 캐시에 있는 전체(200) 응답에서 Range 요청에 답한다
+ *
+ * "Range: bytes=a-b,c-,-n"의 구간이 하나면 206과 Content-Range를, 여럿이면
+ * multipart/byteranges로 보낸다. 만족하는 구간이 없으면 416. If-Range가 있으면
+ * 캐시된 응답의 강한 ETag이나 Last-Modified와 같을 때만 부분 응답을 한다.
+ * 캐시에 없는 Range 요청은 proxy가 그대로 end server에 넘긴다 (206은 캐시하지 않는다).
+ */
+#ifndef __RANGE_H__
+#define __RANGE_H__
+
+#include "csapp.h"
+#include "arena.h"
+
+#define RANGE_MAX 8                           /* 이보다 많은 구간을 요구하면 Range를 무시한다 */
+#define RANGE_BOUNDARY "PROXY_BYTERANGES_9c1f" /* multipart/byteranges 구분자 */
+
+/* resp(헤더 + 본문, size 바이트)에서 range/if_range(헤더 값)에 맞는 응답을 fd로 보내고
+   보낸 바이트 수를 돌려준다. Range를 따를 수 없어 전체 응답을 보내야 하면 -1 */
+ssize_t range_serve(arena_t *arena, int fd, char *resp, size_t size, char *range, char *if_range);
+
+/* 206 응답의 "Content-Range: bytes a-b/total"에서 total. 없거나 모르면 -1 */
+long range_total(char *resp, size_t len);
+
+#endif /* __RANGE_H__ */
@@ -0,0 +1,618 @@
+/*
+ * relay.c - end server → client 응답 중계 백엔드 (rio / io_uring)
+ *
+ * rio 백엔드는 줄 단위로 읽고 쓰기 때문에 응답 한 줄마다 read/write 시스템 콜이 나간다.
+ * uring 백엔드는 relay_chunk 단위 더블 버퍼를 쓰며, 청크 하나를 client에 쓰는 동안
+ * 다음 청크를 end server에서 읽어오도록 두 요청을 io_uring_enter() 한 번에 제출한다.
+ * 등록 버퍼(IORING_REGISTER_BUFFERS)를 사용하므로 매 요청마다 페이지를 고정하는 비용이 없다.
+ * 버퍼는 전역 메모리 예산(budget.h)에서 확보하고, 모자라면 그 쓰레드는 rio로 중계한다.
+ *
+ * recv → send를 IOSQE_IO_LINK로 묶으면 send 길이를 recv 결과로 채울 수 없으므로,
+ * link는 길이가 미리 정해진 "request header 전송 → 첫 응답 읽기"에만 사용한다.
+ */
+#include "csapp.h"
+#include "relay.h"
+#include "hist.h"
+#include "log.h"
+#include "budget.h"
+#include "config.h"
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <linux/io_uring.h>
+
+#define RELAY_BUFSIZE 65536 /* uring 중계 버퍼 하나의 최대 크기 */
+#define RELAY_MINBUF 4096
+#define URING_ENTRIES 8     /* 한 번에 떠 있는 요청은 많아야 2개 */
+
+/* 등록 버퍼 인덱스: 0 = request header, 1/2 = 응답 더블 버퍼 */
+#define BUF_HDR 0
+#define BUF_NR 3
+
+/* completion을 구분하기 위한 user_data 값 */
+enum
+{
+  TAG_WRITE_HDR = 1,
+  TAG_READ,
+  TAG_WRITE,
+  TAG_ACCEPT,
+  TAG_TIMEOUT,
+  TAG_STOP,  /* stop_fd poll */
+  TAG_CANCEL /* multishot accept 취소 */
+};
+
+typedef struct
+{
+  int fd;
+  unsigned sq_entries, sq_tail;
+  unsigned *sq_head, *sq_ktail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *ring_ptr, *sqes_ptr;
+  size_t ring_sz, sqes_sz;
+  char *bufs[BUF_NR]; /* register_bufs일 때만 사용 */
+} uring_t;
+
+static relay_backend_t backend = RELAY_RIO;
+static size_t relay_chunk = RELAY_BUFSIZE; /* conn_budget의 절반 */
+
+/* ring 하나가 전역 예산에서 가져가는 양 */
+#define RING_BYTES (MAXLINE + 2 * relay_chunk)
+
+/* io_uring은 thread-safe하지 않으므로 relay용 ring은 쓰레드마다 하나씩 만든다 */
+static pthread_key_t ring_key;
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+static __thread uring_t *thread_ring;
+
+/* accept는 main 쓰레드만 하므로 전용 ring 하나를 둔다 */
+static uring_t accept_ring;
+static int accept_multishot = 1; /* 커널이 multishot을 거부하면 0 */
+static int accept_armed;
+static int stop_fd = -1;  /* relay_accept_stop()이 쓰면 relay_accept()가 -1을 돌려준다 */
+static int stop_armed, stopping;
+
+/***************************
+ * 최소한의 io_uring 래퍼
+ ***************************/
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete)
+{
+  return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, IORING_ENTER_GETEVENTS, NULL, 0);
+}
+
+static void uring_free(uring_t *r)
+{
+  int i;
+
+  if (r->sqes_ptr)
+    munmap(r->sqes_ptr, r->sqes_sz);
+  if (r->ring_ptr)
+    munmap(r->ring_ptr, r->ring_sz);
+  for (i = 0; i < BUF_NR; i++)
+    free(r->bufs[i]);
+  close(r->fd);
+  memset(r, 0, sizeof(*r));
+}
+
+static int uring_setup(uring_t *r, int register_bufs)
+{
+  struct io_uring_params p;
+  struct iovec iov[BUF_NR];
+  char *ring;
+  size_t sq_sz, cq_sz;
+  int i;
+
+  memset(r, 0, sizeof(*r));
+  memset(&p, 0, sizeof(p));
+  if ((r->fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p)) < 0)
+    return -1;
+  /* SQ/CQ를 한 번의 mmap으로 매핑할 수 있는 커널(5.4+)만 지원 */
+  if (!(p.features & IORING_FEAT_SINGLE_MMAP))
+  {
+    close(r->fd);
+    errno = ENOSYS;
+    return -1;
+  }
+
+  sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  r->ring_sz = sq_sz > cq_sz ? sq_sz : cq_sz;
+  r->ring_ptr = mmap(0, r->ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+  if (r->ring_ptr == MAP_FAILED)
+  {
+    r->ring_ptr = NULL;
+    uring_free(r);
+    return -1;
+  }
+  r->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+  r->sqes_ptr = mmap(0, r->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+  if (r->sqes_ptr == MAP_FAILED)
+  {
+    r->sqes_ptr = NULL;
+    uring_free(r);
+    return -1;
+  }
+
+  ring = r->ring_ptr;
+  r->sq_entries = p.sq_entries;
+  r->sq_head = (unsigned *)(ring + p.sq_off.head);
+  r->sq_ktail = (unsigned *)(ring + p.sq_off.tail);
+  r->sq_mask = (unsigned *)(ring + p.sq_off.ring_mask);
+  r->sq_array = (unsigned *)(ring + p.sq_off.array);
+  r->cq_head = (unsigned *)(ring + p.cq_off.head);
+  r->cq_tail = (unsigned *)(ring + p.cq_off.tail);
+  r->cq_mask = (unsigned *)(ring + p.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+  r->sqes = r->sqes_ptr;
+  r->sq_tail = *r->sq_ktail;
+
+  if (!register_bufs)
+    return 0;
+
+  for (i = 0; i < BUF_NR; i++)
+  {
+    iov[i].iov_len = (i == BUF_HDR) ? MAXLINE : relay_chunk;
+    if ((r->bufs[i] = malloc(iov[i].iov_len)) == NULL)
+    {
+      uring_free(r);
+      return -1;
+    }
+    iov[i].iov_base = r->bufs[i];
+  }
+  if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_BUFFERS, iov, BUF_NR) < 0)
+  {
+    uring_free(r);
+    return -1;
+  }
+  return 0;
+}
+
+/* 비어 있는 SQE 하나를 얻는다. 제출은 uring_submit_wait()에서 한꺼번에 */
+static struct io_uring_sqe *uring_sqe(uring_t *r, int op, int fd, void *addr, unsigned len, unsigned long long tag)
+{
+  unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+  unsigned idx;
+  struct io_uring_sqe *sqe;
+
+  if (r->sq_tail - head >= r->sq_entries)
+    return NULL;
+  idx = r->sq_tail & *r->sq_mask;
+  sqe = &r->sqes[idx];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = op;
+  sqe->fd = fd;
+  sqe->addr = (unsigned long)addr;
+  sqe->len = len;
+  sqe->user_data = tag;
+  r->sq_array[idx] = idx;
+  r->sq_tail++;
+  return sqe;
+}
+
+/* 아직 제출하지 않은 마지막 SQE n개를 버린다 */
+static void uring_unprep(uring_t *r, unsigned n)
+{
+  r->sq_tail -= n;
+}
+
+/* 쌓인 SQE를 커널에 넘기고 completion이 want개 이상 될 때까지 기다린다 */
+static int uring_submit_wait(uring_t *r, unsigned want)
+{
+  unsigned ready;
+
+  __atomic_store_n(r->sq_ktail, r->sq_tail, __ATOMIC_RELEASE);
+  while (1)
+  {
+    ready = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE) - *r->cq_head;
+    if (ready >= want && r->sq_tail == __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE))
+      return 0;
+    if (uring_enter(r->fd, r->sq_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE), want - (ready < want ? ready : want)) < 0 && errno != EINTR)
+      return -1;
+  }
+}
+
+/* SQ ring에 빈 칸을 n개 이상 만든다. 모자라면 쌓인 SQE를 먼저 제출한다. 그래도 모자라면 -1.
+   link로 묶는 SQE들은 같이 제출되어야 하므로 묶음을 준비하기 전에 그 수만큼 확보한다 */
+static int uring_room(uring_t *r, unsigned n)
+{
+  if (r->sq_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) + n <= r->sq_entries)
+    return 0;
+  if (uring_submit_wait(r, 0) < 0)
+    return -1;
+  if (r->sq_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) + n > r->sq_entries)
+  {
+    errno = EBUSY;
+    return -1;
+  }
+  return 0;
+}
+
+/* completion 하나를 꺼낸다. 없으면 0 */
+static int uring_reap(uring_t *r, struct io_uring_cqe *out)
+{
+  unsigned head = *r->cq_head;
+
+  if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+    return 0;
+  *out = r->cqes[head & *r->cq_mask];
+  __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+static void ring_destroy(void *vr)
+{
+  uring_free(vr);
+  free(vr);
+  budget_release(RING_BYTES);
+}
+
+static void ring_key_init(void)
+{
+  pthread_key_create(&ring_key, ring_destroy);
+}
+
+/* 현재 쓰레드의 relay용 ring. 만들 수 없으면 NULL */
+static uring_t *uring_thread(void)
+{
+  uring_t *r;
+
+  if (thread_ring)
+    return thread_ring;
+  Pthread_once(&ring_once, ring_key_init);
+  if (!budget_reserve(RING_BYTES))
+    return NULL;
+  if ((r = malloc(sizeof(uring_t))) == NULL || uring_setup(r, 1) < 0)
+  {
+    free(r);
+    budget_release(RING_BYTES);
+    return NULL;
+  }
+  pthread_setspecific(ring_key, r);
+  return thread_ring = r;
+}
+
+/* 커널이 우리가 쓰는 opcode를 모두 지원하는지 확인한다 */
+static int uring_probe(uring_t *r)
+{
+  static const int ops[] = {IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED, IORING_OP_ACCEPT};
+  size_t len = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+  struct io_uring_probe *probe = calloc(1, len);
+  int i, ok = 1;
+
+  if (probe == NULL)
+    return 0;
+  if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) < 0)
+    ok = 0;
+  for (i = 0; ok && i < (int)(sizeof(ops) / sizeof(ops[0])); i++)
+    if (ops[i] > probe->last_op || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED))
+      ok = 0;
+  free(probe);
+  return ok;
+}
+
+/***************************
+ * 백엔드 선택
+ ***************************/
+
+relay_backend_t relay_init(const char *name, size_t conn_budget)
+{
+  uring_t probe;
+
+  if ((stop_fd = eventfd(0, EFD_CLOEXEC)) < 0)
+    unix_error("eventfd error");
+  relay_chunk = conn_budget / 2;
+  if (relay_chunk > RELAY_BUFSIZE)
+    relay_chunk = RELAY_BUFSIZE;
+  if (relay_chunk < RELAY_MINBUF)
+    relay_chunk = RELAY_MINBUF;
+
+  backend = RELAY_RIO;
+  if (name == NULL || strcmp(name, "uring"))
+    return backend;
+
+  if (uring_setup(&accept_ring, 0) < 0)
+  {
+    fprintf(stderr, "io_uring unavailable (%s), falling back to rio\n", strerror(errno));
+    return backend;
+  }
+  if (!uring_probe(&accept_ring) || uring_setup(&probe, 1) < 0)
+  {
+    fprintf(stderr, "io_uring lacks required features, falling back to rio\n");
+    uring_free(&accept_ring);
+    return backend;
+  }
+  uring_free(&probe);
+  return backend = RELAY_URING;
+}
+
+const char *relay_backend_name(void)
+{
+  return backend == RELAY_URING ? "uring" : "rio";
+}
+
+/***************************
+ * accept
+ ***************************/
+
+void relay_accept_stop(void)
+{
+  uint64_t one = 1;
+
+  if (write(stop_fd, &one, sizeof(one)) < 0)
+    unix_error("eventfd write error");
+}
+
+int relay_accept(int listenfd, SA *addr, socklen_t *addrlen)
+{
+  struct io_uring_sqe *sqe;
+  struct io_uring_cqe cqe;
+  struct pollfd pfd[2] = {{listenfd, POLLIN, 0}, {stop_fd, POLLIN, 0}};
+
+  if (backend != RELAY_URING || !accept_multishot)
+  {
+    /* stop_fd를 같이 기다려야 accept에 묶인 채로 남지 않는다 */
+    while (poll(pfd, 2, -1) < 0)
+      if (errno != EINTR)
+        unix_error("Poll error");
+    if (pfd[1].revents)
+      return -1;
+    return Accept(listenfd, addr, addrlen);
+  }
+
+  while (1)
+  {
+    if (!stop_armed)
+    {
+      if (uring_room(&accept_ring, 1) < 0 || (sqe = uring_sqe(&accept_ring, IORING_OP_POLL_ADD, stop_fd, NULL, 0, TAG_STOP)) == NULL)
+        unix_error("Accept error");
+      sqe->poll32_events = POLLIN;
+      stop_armed = 1;
+    }
+    /* multishot accept는 한 번 걸어두면 연결마다 completion이 하나씩 나온다 */
+    if (!accept_armed)
+    {
+      if (stopping)
+        return -1;
+      if (uring_room(&accept_ring, 1) < 0 || (sqe = uring_sqe(&accept_ring, IORING_OP_ACCEPT, listenfd, NULL, 0, TAG_ACCEPT)) == NULL)
+        unix_error("Accept error");
+      sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+      accept_armed = 1;
+    }
+    if (uring_submit_wait(&accept_ring, 1) < 0)
+      unix_error("Accept error");
+    uring_reap(&accept_ring, &cqe);
+    if (cqe.user_data == TAG_STOP)
+    {
+      /* 커널이 이미 받아 둔 연결은 마저 돌려주고, 더 받지 않도록 multishot을 취소한다 */
+      stopping = 1;
+      if (uring_room(&accept_ring, 1) < 0 ||
+          uring_sqe(&accept_ring, IORING_OP_ASYNC_CANCEL, -1, (void *)(unsigned long)TAG_ACCEPT, 0, TAG_CANCEL) == NULL)
+        unix_error("Accept error");
+      continue;
+    }
+    if (cqe.user_data == TAG_CANCEL)
+      continue;
+    /* F_MORE가 없으면 multishot이 끝난 것이므로 다음에 다시 건다 */
+    if (!(cqe.flags & IORING_CQE_F_MORE))
+      accept_armed = 0;
+    if (cqe.res >= 0)
+      break;
+    if (cqe.res == -EINVAL)
+    {
+      /* multishot을 모르는 커널(5.19 미만): 일반 accept로 */
+      accept_multishot = 0;
+      return relay_accept(listenfd, addr, addrlen);
+    }
+    if (stopping && cqe.res == -ECANCELED)
+      continue;
+    if (cqe.res != -EINTR && cqe.res != -ECONNABORTED)
+    {
+      errno = -cqe.res;
+      unix_error("Accept error");
+    }
+  }
+
+  /* multishot에서는 주소 버퍼를 공유할 수 없으므로 연결마다 따로 가져온다 */
+  if (getpeername(cqe.res, addr, addrlen) < 0)
+    *addrlen = 0;
+  return cqe.res;
+}
+
+/***************************
+ * 응답 중계
+ ***************************/
+
+/* 읽기 하나를 준비하고, deadline(ms)이 있으면 IORING_OP_LINK_TIMEOUT을 뒤에 묶는다.
+   ts는 제출할 때까지 살아 있어야 한다. 준비한 SQE 수를 반환. SQ ring에 자리가 없으면 아무것도
+   준비하지 않고 -1 */
+static int uring_prep_read(uring_t *r, int fd, int idx, int ms, struct __kernel_timespec *ts)
+{
+  struct io_uring_sqe *sqe;
+
+  if (uring_room(r, ms > 0 ? 2 : 1) < 0 ||
+      (sqe = uring_sqe(r, IORING_OP_READ_FIXED, fd, r->bufs[idx], relay_chunk, TAG_READ)) == NULL)
+    return -1;
+  sqe->buf_index = idx;
+  if (ms <= 0)
+    return 1;
+  sqe->flags |= IOSQE_IO_LINK;
+  ts->tv_sec = ms / 1000;
+  ts->tv_nsec = (ms % 1000) * 1000000LL;
+  if (uring_sqe(r, IORING_OP_LINK_TIMEOUT, -1, ts, 1, TAG_TIMEOUT) == NULL)
+  {
+    uring_unprep(r, 1);
+    return -1;
+  }
+  return 2;
+}
+
+/* 제출한 want개의 요청이 모두 끝날 때까지 기다려 쓰기/읽기 결과를 돌려준다.
+   timer가 먼저 터져 취소된 읽기는 -ETIMEDOUT으로 바꾼다 */
+static int uring_wait(uring_t *r, int want, int *wres, int *rres)
+{
+  struct io_uring_cqe cqe;
+  int got = 0, expired = 0;
+
+  if (uring_submit_wait(r, want) < 0)
+    return -1;
+  while (got < want && uring_reap(r, &cqe))
+  {
+    if (cqe.user_data == TAG_READ)
+      *rres = cqe.res;
+    else if (cqe.user_data == TAG_TIMEOUT)
+      expired = cqe.res == -ETIME;
+    else
+      *wres = cqe.res;
+    got++;
+  }
+  if (expired && *rres == -ECANCELED)
+    *rres = -ETIMEDOUT;
+  return 0;
+}
+
+/* 0이면 끝까지 중계, -1이면 실패(errno). SQ ring에 자리가 없어 시작도 못 했으면 1 */
+static int uring_transfer(uring_t *r, int end_serverfd, int connfd, char *http_header, size_t header_len,
+                          relay_sink_t sink, void *arg, size_t *relayed)
+{
+  struct io_uring_sqe *sqe;
+  struct __kernel_timespec ts;
+  int cur = 1, wres = 0, n = 0, len, want;
+  long long start = hist_now(), first;
+  config_t *cfg = config_get();
+
+  /* request header 전송 → 첫 응답 읽기(→ first-byte timer)를 link로 묶어 한 번에 제출.
+     SQ ring에 자리가 없으면 아직 아무것도 보내지 않았으므로 rio로 넘긴다 */
+  memcpy(r->bufs[BUF_HDR], http_header, header_len);
+  if (uring_room(r, 3) < 0 ||
+      (sqe = uring_sqe(r, IORING_OP_WRITE_FIXED, end_serverfd, r->bufs[BUF_HDR], header_len, TAG_WRITE_HDR)) == NULL)
+    return 1;
+  sqe->buf_index = BUF_HDR;
+  sqe->flags = IOSQE_IO_LINK;
+  if ((want = uring_prep_read(r, end_serverfd, cur, cfg->first_byte_ms, &ts)) < 0)
+  {
+    uring_unprep(r, 1);
+    return 1;
+  }
+  if (uring_wait(r, want + 1, &wres, &n) < 0)
+    return -1;
+  if (wres < 0)
+  {
+    errno = -wres;
+    return -1;
+  }
+  if (wres < (int)header_len)
+  {
+    /* short write면 link가 끊겨 읽기가 취소된다: 나머지를 보내고 읽기를 다시 건다 */
+    if (rio_writen(end_serverfd, r->bufs[BUF_HDR] + wres, header_len - wres) < 0)
+      return -1;
+    if ((want = uring_prep_read(r, end_serverfd, cur, cfg->first_byte_ms, &ts)) < 0 ||
+        uring_wait(r, want, &wres, &n) < 0)
+      return -1;
+  }
+  first = hist_now();
+  hist_record(PHASE_FIRST_BYTE, first - start);
+
+  /* 청크 cur를 client에 쓰는 동안 다음 청크를 다른 버퍼로 읽는다 */
+  while (n > 0)
+  {
+    len = n;
+    if (uring_room(r, 3) < 0 || (sqe = uring_sqe(r, IORING_OP_WRITE_FIXED, connfd, r->bufs[cur], len, TAG_WRITE)) == NULL)
+      return -1;
+    sqe->buf_index = cur;
+    /* 두 버퍼가 모두 차 있는 동안에는 새 읽기를 걸지 않으므로 연결당 버퍼는 2 * relay_chunk로 묶인다 */
+    if ((want = uring_prep_read(r, end_serverfd, 3 - cur, cfg->idle_ms, &ts)) < 0)
+    {
+      uring_unprep(r, 1);
+      return -1;
+    }
+    if (uring_wait(r, want + 1, &wres, &n) < 0)
+      return -1;
+    if (wres < 0)
+    {
+      errno = -wres;
+      return -1;
+    }
+    if (wres < len && rio_writen(connfd, r->bufs[cur] + wres, len - wres) < 0)
+      return -1;
+    LOGF(LOG_DEBUG, "proxy received %ld bytes,then send", NULL, len);
+    if (sink)
+      sink(arg, r->bufs[cur], len);
+    *relayed += len;
+    cur = 3 - cur;
+  }
+  hist_record(PHASE_TRANSFER, hist_now() - first);
+  if (n < 0)
+  {
+    errno = -n;
+    return -1;
+  }
+  return 0;
+}
+
+/* 소켓의 SO_RCVTIMEO. 커널 timer라 read()가 ms 동안 아무것도 못 받으면 EAGAIN으로 돌아온다 */
+static void set_rcvtimeo(int fd, int ms)
+{
+  struct timeval tv;
+
+  tv.tv_sec = ms / 1000;
+  tv.tv_usec = (ms % 1000) * 1000;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+static int rio_transfer(int end_serverfd, int connfd, char *http_header, size_t header_len,
+                        relay_sink_t sink, void *arg, size_t *relayed)
+{
+  char buf[MAXLINE];
+  rio_t server_rio;
+  ssize_t n;
+  long long start = hist_now(), first = 0;
+  config_t *cfg = config_get();
+
+  Rio_readinitb(&server_rio, end_serverfd);
+  if (cfg->first_byte_ms > 0)
+    set_rcvtimeo(end_serverfd, cfg->first_byte_ms);
+  /*write the http header to endserver*/
+  Rio_writen(end_serverfd, http_header, header_len);
+
+  /*receive message from end server and send to the client*/
+  while ((n = rio_readlineb(&server_rio, buf, MAXLINE)) > 0)
+  {
+    if (!first)
+    {
+      first = hist_now();
+      hist_record(PHASE_FIRST_BYTE, first - start);
+      /* 첫 바이트 이후로는 idle deadline */
+      set_rcvtimeo(end_serverfd, cfg->idle_ms > 0 ? cfg->idle_ms : 0);
+    }
+    LOGF(LOG_DEBUG, "proxy received %ld bytes,then send", NULL, n);
+    Rio_writen(connfd, buf, n);
+    if (sink)
+      sink(arg, buf, n);
+    *relayed += n;
+  }
+  if (first)
+    hist_record(PHASE_TRANSFER, hist_now() - first);
+  if (n < 0)
+  {
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      errno = ETIMEDOUT;
+    return -1;
+  }
+  return 0;
+}
+
+int relay_transfer(int end_serverfd, int connfd, char *http_header, size_t header_len,
+                   relay_sink_t sink, void *arg, size_t *relayed)
+{
+  uring_t *r;
+  int rc;
+
+  *relayed = 0;
+  /* uring_transfer가 1이면 SQ ring에 자리가 없어 아무것도 보내지 못한 것이므로 rio로 보낸다 */
+  if (backend == RELAY_URING && header_len <= MAXLINE && (r = uring_thread()) != NULL &&
+      (rc = uring_transfer(r, end_serverfd, connfd, http_header, header_len, sink, arg, relayed)) <= 0)
+    return rc;
+  return rio_transfer(end_serverfd, connfd, http_header, header_len, sink, arg, relayed);
+}
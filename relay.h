@@ -0,0 +1,49 @@
+/*
+ * relay.h - end server의 응답을 client로 중계(relay)하는 I/O 백엔드
+ *
+ * rio   : 기존 Rio_readlineb/Rio_writen 루프 (항상 사용 가능)
+ * uring : io_uring 기반. 등록 버퍼(READ_FIXED/WRITE_FIXED), multishot accept,
+ *         request 전송과 첫 응답 읽기를 IOSQE_IO_LINK로 묶어 한 번에 제출한다.
+ *         커널이 지원하지 않으면 relay_init()이 rio로 되돌아간다.
+ *
+ * end server가 응답하지 않아도 쓰레드가 묶이지 않도록 읽기마다 deadline을 건다.
+ * uring은 IORING_OP_LINK_TIMEOUT, rio는 SO_RCVTIMEO로 커널 timer를 쓴다.
+ */
+#ifndef __RELAY_H__
+#define __RELAY_H__
+
+#include "csapp.h"
+
+#define DEFAULT_FIRST_BYTE_MS 10000 /* request를 보낸 뒤 첫 응답 바이트까지 */
+#define DEFAULT_IDLE_MS 30000       /* 응답 도중 아무것도 오지 않는 시간 */
+
+typedef enum
+{
+  RELAY_RIO,
+  RELAY_URING
+} relay_backend_t;
+
+/* name("rio" / "uring")에 해당하는 백엔드를 선택한다. 실제로 선택된 백엔드를 반환.
+   conn_budget은 연결 하나가 end server에서 읽어 client로 아직 못 보낸 채 쥐고 있을 수 있는 양이다.
+   uring은 이 절반 크기의 버퍼 두 개로 중계하고, 버퍼가 둘 다 차 있으면 client가 가져갈 때까지
+   end server에서 더 읽지 않는다 */
+relay_backend_t relay_init(const char *name, size_t conn_budget);
+const char *relay_backend_name(void);
+
+/* listenfd에서 연결 하나를 받아온다. uring이면 multishot accept의 completion을 하나 꺼낸다.
+   relay_accept_stop() 뒤로는 (이미 커널이 받아 둔 연결을 다 돌려준 다음) -1 */
+int relay_accept(int listenfd, SA *addr, socklen_t *addrlen);
+
+/* 다른 쓰레드에서 부른다: accept를 멈추게 한다 (drain.h) */
+void relay_accept_stop(void);
+
+/* 중계되는 응답 청크마다 호출된다 (예: cache_fill) */
+typedef void (*relay_sink_t)(void *arg, char *buf, size_t n);
+
+/* http_header를 end server에 보내고, 응답을 EOF까지 connfd로 중계한다.
+   sink가 NULL이 아니면 청크마다 sink(arg, ...)를 부른다. *relayed에는 client로 보낸 바이트 수.
+   성공하면 0, 실패하면 -1 (deadline을 넘기면 errno = ETIMEDOUT) */
+int relay_transfer(int end_serverfd, int connfd, char *http_header, size_t header_len,
+                   relay_sink_t sink, void *arg, size_t *relayed);
+
+#endif /* __RELAY_H__ */
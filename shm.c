@@ -0,0 +1,47 @@
+/*
+ * shm.c - shm_open/익명 MAP_SHARED 영역 할당
+ */
+#include "csapp.h"
+#include "shm.h"
+#include <sys/statvfs.h>
+
+static int named;
+static int seq; /* 이 process가 만든 segment 수. 이름을 겹치지 않게 */
+
+void shm_init(int use_named)
+{
+  named = use_named;
+}
+
+size_t shm_room(void)
+{
+  struct statvfs sv;
+
+  if (!named || statvfs(SHM_DIR, &sv) < 0)
+    return (size_t)-1;
+  return (size_t)sv.f_bavail * sv.f_frsize;
+}
+
+void *shm_alloc(size_t bytes)
+{
+  char name[64];
+  void *p;
+  int fd = -1, flags = MAP_SHARED | MAP_NORESERVE;
+
+  if (named)
+  {
+    snprintf(name, sizeof(name), "/proxy-%ld-%d", (long)getpid(), seq++);
+    if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0)
+      unix_error("shm_open error");
+    shm_unlink(name);
+    if (ftruncate(fd, bytes) < 0)
+      unix_error("shm ftruncate error");
+  }
+  else
+    flags |= MAP_ANONYMOUS;
+  if ((p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, flags, fd, 0)) == MAP_FAILED)
+    unix_error("shm mmap error");
+  if (fd >= 0)
+    Close(fd);
+  return p;
+}
@@ -0,0 +1,30 @@
+/*
+ * shm.h - worker process들이 함께 쓰는 공유 메모리
+ *
+ * -m으로 worker process를 여러 개 띄우면 캐시 색인과 본문(cache.h, slab.h, tinylfu.h), 통계
+ * 카운터, prefetch 예산이 모든 worker에게 하나여야 한다. master가 fork하기 전에 shm_alloc()으로
+ * MAP_SHARED 영역을 잡아 두면, fork한 worker들은 같은 물리 page를 같은 주소로 보므로 영역 안에
+ * 그대로 포인터를 넣어 쓸 수 있다. fork 뒤에 잡은 영역은 그 process(와 그 자식)만 본다.
+ *
+ * shm_init(1) 뒤로는 영역마다 shm_open으로 /dev/shm에 segment를 만들어 mmap하고 이름은 바로
+ * 지운다. 모든 process가 끝나면 segment도 사라지고, master가 죽어도 이름이 남지 않는다.
+ * 그 전에는 익명 공유 mmap을 쓴다 (한 process 안에서는 차이가 없다).
+ */
+#ifndef __SHM_H__
+#define __SHM_H__
+
+#include "csapp.h"
+
+#define SHM_DIR "/dev/shm"
+
+/* named가 1이면 이후의 shm_alloc()은 shm_open segment를 쓴다 */
+void shm_init(int named);
+
+/* 0으로 채운 bytes짜리 공유 영역. 실제로 쓰기 전까지는 물리 메모리를 잡지 않는다. 실패하면 종료 */
+void *shm_alloc(size_t bytes);
+
+/* shm_open segment를 쓰면 SHM_DIR에 남은 바이트 (그보다 많이 쓰면 page를 처음 건드릴 때 SIGBUS).
+   익명 mmap이면 (size_t)-1 */
+size_t shm_room(void);
+
+#endif /* __SHM_H__ */
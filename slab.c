@@ -0,0 +1,282 @@
+/*
+ * slab.c - page/size-class slot과 page run 할당기
+ */
+#include "csapp.h"
+#include "slab.h"
+#include "stats.h"
+#include "shm.h"
+#include <stdint.h>
+
+typedef struct
+{
+  int cls;         /* SLAB_RUN이면 run의 첫 page. 쓰이지 않는 page에서는 의미 없음 */
+  int used;        /* class page면 쓰이고 있는 slot 수, run이면 page 수 */
+  void *free;      /* 이 page의 빈 slot 목록 (slot 첫 8바이트에 다음 slot) */
+  int prev, next;  /* 빈 slot이 있는 같은 class page들의 목록 */
+} page_t;
+
+/* 여러 worker process가 함께 바꾸는 값 */
+typedef struct
+{
+  int limit;                 /* 앞에서부터 쓸 수 있는 page 수 (slab_set_limit) */
+  int high;                  /* 이 번호부터는 쓰이는 page가 없다 */
+  int partial[SLAB_CLASSES]; /* class마다 빈 slot이 있는 page 목록의 head */
+} slab_state_t;
+
+/* 포인터들은 slab_init() 뒤로 바뀌지 않는다. 가리키는 곳은 모두 공유 메모리(shm.h) */
+static char *region;
+static page_t *pages;
+static uint64_t *inuse;  /* page마다 1비트. 쓰이고 있으면 1 */
+static int npages;
+static int os_pages;     /* 물리 page 하나에 든 slab page 수. madvise는 이 단위로만 한다 */
+static slab_state_t *st;
+
+static size_t class_size(int cls)
+{
+  return (size_t)(cls % 2 ? 3 * SLAB_MIN / 2 : SLAB_MIN) << (cls / 2);
+}
+
+int slab_class(size_t size)
+{
+  int cls = 0;
+
+  if (size > class_size(SLAB_CLASSES - 1))
+    return SLAB_RUN;
+  while (class_size(cls) < size)
+    cls++;
+  return cls;
+}
+
+int slab_pages(size_t size)
+{
+  return slab_class(size) == SLAB_RUN ? (size + SLAB_PAGE - 1) / SLAB_PAGE : 1;
+}
+
+int slab_page_of(void *p)
+{
+  return ((char *)p - region) / SLAB_PAGE;
+}
+
+int slab_class_of(void *p)
+{
+  return pages[slab_page_of(p)].cls;
+}
+
+int slab_span_of(void *p)
+{
+  page_t *page = &pages[slab_page_of(p)];
+
+  return page->cls == SLAB_RUN ? page->used : 1;
+}
+
+int slab_limit(void)
+{
+  return st->limit;
+}
+
+static int used(int pg)
+{
+  return inuse[pg / 64] >> (pg % 64) & 1;
+}
+
+void slab_init(size_t bytes)
+{
+  npages = bytes / SLAB_PAGE;
+  os_pages = sysconf(_SC_PAGESIZE) > SLAB_PAGE ? sysconf(_SC_PAGESIZE) / SLAB_PAGE : 1;
+  /* 실제로 쓰기 전까지는 물리 메모리를 잡지 않는다. page 표도 쓰는 page의 것만 건드린다 */
+  region = shm_alloc((size_t)npages * SLAB_PAGE);
+  pages = shm_alloc(npages * sizeof(page_t));
+  inuse = shm_alloc((npages / 64 + 1) * sizeof(uint64_t));
+  st = shm_alloc(sizeof(slab_state_t));
+  st->limit = npages;
+  slab_reset();
+}
+
+void slab_reset(void)
+{
+  int i;
+
+  madvise(region, (size_t)st->high * SLAB_PAGE, MADV_REMOVE);
+  memset(inuse, 0, (st->high / 64 + 1) * sizeof(uint64_t));
+  st->high = 0;
+  for (i = 0; i < SLAB_CLASSES; i++)
+    st->partial[i] = -1;
+  /* 죽은 process가 page를 자르다 말았을 수 있으므로 빼지 않고 0으로 둔다 */
+  stats_clear(STAT_CACHE_SLAB_BYTES);
+}
+
+/* 상한 안에서 이어진 빈 page n개의 첫 번호. 없으면 -1. run은 앞에서부터 채운다 */
+static int find_run(int n)
+{
+  int pg, run = 0;
+
+  for (pg = 0; pg < st->limit; pg++)
+  {
+    if (pg % 64 == 0 && inuse[pg / 64] == UINT64_MAX)
+    {
+      run = 0;
+      pg += 63;
+    }
+    else if (used(pg))
+      run = 0;
+    else if (++run == n)
+      return pg - n + 1;
+  }
+  return -1;
+}
+
+/* 상한 안의 빈 page 하나. class page는 뒤에서부터 잡아 run이 쓸 이어진 page를 덜 자른다 */
+static int find_page(void)
+{
+  int pg;
+
+  for (pg = st->limit - 1; pg >= 0; pg--)
+  {
+    if (pg % 64 == 63 && inuse[pg / 64] == UINT64_MAX)
+      pg -= 63;
+    else if (!used(pg))
+      return pg;
+  }
+  return -1;
+}
+
+static void take(int first, int n)
+{
+  int pg;
+
+  for (pg = first; pg < first + n; pg++)
+    inuse[pg / 64] |= 1ULL << (pg % 64);
+  if (first + n > st->high)
+    st->high = first + n;
+  stats_add(STAT_CACHE_SLAB_BYTES, (long)n * SLAB_PAGE);
+}
+
+/* page를 돌려준다. 공유 page는 DONTNEED로는 mapping만 풀리므로, 물리 page가 통째로 비면
+   REMOVE로 page 자체를 돌려준다 */
+static void give(int first, int n)
+{
+  int pg, end;
+
+  for (pg = first; pg < first + n; pg++)
+    inuse[pg / 64] &= ~(1ULL << (pg % 64));
+  for (pg = first / os_pages * os_pages; pg < first + n; pg += os_pages)
+  {
+    for (end = pg; end < pg + os_pages && end < npages && !used(end); end++)
+      ;
+    if (end == pg + os_pages)
+      madvise(region + (size_t)pg * SLAB_PAGE, (size_t)os_pages * SLAB_PAGE, MADV_REMOVE);
+  }
+  stats_add(STAT_CACHE_SLAB_BYTES, -(long)n * SLAB_PAGE);
+}
+
+static void partial_push(int cls, int pg)
+{
+  pages[pg].prev = -1;
+  pages[pg].next = st->partial[cls];
+  if (st->partial[cls] >= 0)
+    pages[st->partial[cls]].prev = pg;
+  st->partial[cls] = pg;
+}
+
+static void partial_unlink(int cls, int pg)
+{
+  if (pages[pg].prev >= 0)
+    pages[pages[pg].prev].next = pages[pg].next;
+  else
+    st->partial[cls] = pages[pg].next;
+  if (pages[pg].next >= 0)
+    pages[pages[pg].next].prev = pages[pg].prev;
+}
+
+/* 빈 page를 class에 배정하고 slot으로 자른다 */
+static int page_carve(int cls)
+{
+  size_t sz = class_size(cls), off;
+  char *base;
+  int pg;
+
+  if ((pg = find_page()) < 0)
+    return -1;
+  take(pg, 1);
+  base = region + (size_t)pg * SLAB_PAGE;
+  pages[pg].cls = cls;
+  pages[pg].used = 0;
+  pages[pg].free = NULL;
+  for (off = SLAB_PAGE / sz * sz; off > 0; off -= sz)
+  {
+    *(void **)(base + off - sz) = pages[pg].free;
+    pages[pg].free = base + off - sz;
+  }
+  partial_push(cls, pg);
+  return pg;
+}
+
+int slab_has_room(size_t size)
+{
+  int cls = slab_class(size);
+
+  if (cls == SLAB_RUN)
+    return find_run(slab_pages(size)) >= 0;
+  return st->partial[cls] >= 0 || find_page() >= 0;
+}
+
+int slab_set_limit(size_t bytes)
+{
+  int pg;
+
+  st->limit = bytes / SLAB_PAGE < (size_t)npages ? bytes / SLAB_PAGE : npages;
+  /* high를 실제로 쓰이는 마지막 page 뒤까지 내린다. 줄어들기만 하므로 상한이 그대로면 바로 끝난다 */
+  for (pg = st->high; pg > st->limit && !used(pg - 1); pg--)
+    ;
+  st->high = pg;
+  return st->high > st->limit;
+}
+
+void *slab_alloc(size_t size)
+{
+  int cls = slab_class(size), pg, n;
+  page_t *page;
+  void *p;
+
+  if (cls == SLAB_RUN)
+  {
+    n = slab_pages(size);
+    if ((pg = find_run(n)) < 0)
+      return NULL;
+    take(pg, n);
+    pages[pg].cls = SLAB_RUN;
+    pages[pg].used = n;
+    return region + (size_t)pg * SLAB_PAGE;
+  }
+  if ((pg = st->partial[cls]) < 0 && (pg = page_carve(cls)) < 0)
+    return NULL;
+  page = &pages[pg];
+  p = page->free;
+  page->free = *(void **)p;
+  page->used++;
+  if (page->free == NULL)
+    partial_unlink(cls, pg);
+  return p;
+}
+
+void slab_free(void *p)
+{
+  int pg = slab_page_of(p), cls = pages[pg].cls;
+  page_t *page = &pages[pg];
+
+  if (cls == SLAB_RUN)
+  {
+    give(pg, page->used);
+    return;
+  }
+  if (page->free == NULL)
+    partial_push(cls, pg);
+  *(void **)p = page->free;
+  page->free = p;
+  if (--page->used > 0)
+    return;
+
+  /* page가 비었다: class page로도 run으로도 다시 쓸 수 있게 돌려준다 */
+  partial_unlink(cls, pg);
+  give(pg, 1);
+}
@@ -0,0 +1,52 @@
+/*
+ * slab.h - 캐시 객체 본문을 위한 page 할당기
+ *
+ * 캐시 크기가 커질 수 있는 만큼의 영역을 시작할 때 한 번 mmap하고 SLAB_PAGE 단위 page로 나눈다.
+ * 그중 앞에서부터 slab_set_limit()로 정한 page까지만 쓴다.
+ * SLAB_PAGE/2 이하의 slot은 size class에서 준다. page 하나가 class 하나에 배정되어 그 class의
+ * slot들로 잘린다. class 크기는 2의 거듭제곱과 그 1.5배(64, 96, 128, ... 512)라 slot 안의 낭비는
+ * 1/3을 넘지 않는다. 그보다 큰 slot은 연속한 page 여러 개(run)를 통째로 준다. 낭비는 마지막 page의
+ * 나머지뿐이라, 크기가 제각각인 응답도 byte 단위로 센 것과 거의 같은 양이 들어간다.
+ * 빈 page는 (그 물리 page가 통째로 비면 madvise로 물리 메모리까지) 돌려받아 class page로도 run으로도
+ * 다시 쓴다. 이어진 빈 page가 모자라면 어느 구간을 비울지는 LRU를 아는 cache.c가 고른다.
+ * malloc/free를 쓰지 않으므로 오래 돌아도 힙이 조각나지 않고, 캐시가 쓰는 메모리는
+ * 사용 중인 page 수 × SLAB_PAGE로 정확히 센다.
+ * 영역과 page 표는 공유 메모리(shm.h)에 있어 fork한 worker process들이 함께 쓴다.
+ *
+ * lock이 없다. 캐시 mutex 안에서만 부른다.
+ */
+#ifndef __SLAB_H__
+#define __SLAB_H__
+
+#include "csapp.h"
+
+#define SLAB_PAGE 1024
+#define SLAB_MIN 64
+#define SLAB_CLASSES 7           /* 64 ... SLAB_PAGE/2 */
+#define SLAB_RUN SLAB_CLASSES    /* run으로 주는 slot의 class */
+
+/* bytes를 SLAB_PAGE 단위로 내림한 영역을 잡는다. 처음 상한은 영역 전체. worker를 fork하기 전에 */
+void slab_init(size_t bytes);
+
+/* 모든 page를 빈 page로 돌린다. 나눠 준 slot은 모두 버려진다 */
+void slab_reset(void);
+
+/* 앞에서부터 bytes만큼의 page만 새로 내주게 한다. 그 뒤의 page가 아직 쓰이고 있으면 1
+   (비울 때까지 그대로 쓰인다) */
+int slab_set_limit(size_t bytes);
+int slab_limit(void); /* 지금 쓸 수 있는 page 수 */
+
+/* size 바이트짜리 slot 하나. 들어갈 빈 slot도 이어진 빈 page도 없으면 NULL */
+void *slab_alloc(size_t size);
+void slab_free(void *p);
+
+/* slab_alloc(size)가 지금 성공하면 1 */
+int slab_has_room(size_t size);
+
+int slab_class(size_t size);  /* size가 들어갈 class. SLAB_PAGE/2보다 크면 SLAB_RUN */
+int slab_pages(size_t size);  /* size의 slot을 새로 내주려면 비어 있어야 하는 이어진 page 수 */
+int slab_class_of(void *p);   /* slot p가 속한 class */
+int slab_page_of(void *p);    /* slot p가 시작하는 page 번호 */
+int slab_span_of(void *p);    /* slot p가 걸친 page 수 (class slot이면 1) */
+
+#endif /* __SLAB_H__ */
@@ -0,0 +1,45 @@
+#!/usr/bin/python3
+
+# slow-server.py - A slow origin server for the driver's perf mode. It
+#                  answers every request with a small page after
+#                  sleeping for a fixed delay, one thread per connection,
+#                  so a proxy that serializes requests shows up as low
+#                  throughput.
+#
+# usage: slow-server.py <port> [delay_ms]
+#
+import socket
+import sys
+import threading
+import time
+
+delay = (int(sys.argv[2]) if len(sys.argv) > 2 else 50) / 1000.0
+body = b"<html><body>slow origin</body></html>\n"
+response = (b"HTTP/1.0 200 OK\r\nContent-type: text/html\r\nContent-length: "
+            + str(len(body)).encode() + b"\r\n\r\n" + body)
+
+def serve(channel):
+  try:
+    # Read until the end of the request headers
+    request = b""
+    while b"\r\n\r\n" not in request:
+      data = channel.recv(4096)
+      if not data:
+        return
+      request += data
+    time.sleep(delay)
+    channel.sendall(response)
+  except OSError:
+    pass
+  finally:
+    channel.close()
+
+#create an INET, STREAMing socket
+serversocket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+serversocket.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+serversocket.bind(('', int(sys.argv[1])))
+serversocket.listen(128)
+
+while 1:
+  channel, details = serversocket.accept()
+  threading.Thread(target=serve, args=(channel,), daemon=True).start()
@@ -0,0 +1,176 @@
+/*
+ * snapshot.c - 캐시 snapshot 저장(SIGTERM, 주기)과 mmap으로 읽어 들이기
+ */
+#include "csapp.h"
+#include "snapshot.h"
+#include "cache.h"
+#include "hist.h"
+#include "log.h"
+#include <stdint.h>
+
+typedef struct
+{
+  uint32_t keylen, datalen;
+  int64_t stored, expires;
+} snap_rec_t;
+
+static const char *snap_path;
+static int snap_interval;
+static int disabled; /* atomic: 새 process에 넘겨준 뒤로는 저장하지 않는다 */
+/* 저장 하나가 끝날 때까지 다른 저장과 snapshot_disable()을 막는다. 주기 저장 쓰레드와 drain이
+   같은 "<path>.tmp"에 O_TRUNC로 번갈아 쓰면 rename되는 파일이 섞인다 */
+static pthread_mutex_t save_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void snapshot_init(const char *path, int interval_s)
+{
+  snap_path = path;
+  snap_interval = interval_s;
+}
+
+int snapshot_enabled(void)
+{
+  return snap_path != NULL && !__atomic_load_n(&disabled, __ATOMIC_RELAXED);
+}
+
+void snapshot_disable(void)
+{
+  /* 진행 중인 저장이 끝난 뒤로는 파일을 건드리지 않는다 */
+  pthread_mutex_lock(&save_lock);
+  __atomic_store_n(&disabled, 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&save_lock);
+}
+
+static int save(void)
+{
+  char tmp[MAXLINE];
+  cache_obj_t **objs;
+  snap_rec_t rec;
+  int fd, i, n, ok = 1;
+
+  snprintf(tmp, sizeof(tmp), "%s.tmp", snap_path);
+  if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+  {
+    LOGF(LOG_ERROR, "snapshot: cannot open %s", tmp);
+    return -1;
+  }
+
+  /* 쓰는 동안 객체가 evict돼도 해제되지 않도록 모두 빌려온다. 캐시 lock은 잡지 않는다 */
+  objs = cache_borrow_all(&n);
+  ok = rio_writen(fd, SNAP_MAGIC, 8) == 8;
+  for (i = 0; i < n; i++)
+  {
+    rec.keylen = strlen(objs[i]->key);
+    rec.datalen = objs[i]->size;
+    rec.stored = objs[i]->stored;
+    rec.expires = objs[i]->expires;
+    if (ok)
+      ok = rio_writen(fd, &rec, sizeof(rec)) == sizeof(rec) &&
+           rio_writen(fd, objs[i]->key, rec.keylen) == rec.keylen &&
+           rio_writen(fd, objs[i]->data, rec.datalen) == rec.datalen;
+    cache_release(objs[i]);
+  }
+  Free(objs);
+
+  ok = ok && fsync(fd) == 0;
+  close(fd);
+  if (!ok || rename(tmp, snap_path) < 0)
+  {
+    LOGF(LOG_ERROR, "snapshot: failed to write %s", snap_path);
+    unlink(tmp);
+    return -1;
+  }
+  return n;
+}
+
+int snapshot_save(void)
+{
+  int n = -1;
+
+  pthread_mutex_lock(&save_lock);
+  if (snapshot_enabled())
+    n = save();
+  pthread_mutex_unlock(&save_lock);
+  return n;
+}
+
+/* 파일 전체를 mmap해 만료되지 않은 객체를 캐시에 넣는다. 넣은 수를 반환 */
+static int load(void)
+{
+  struct stat st;
+  char *map, *p, *end, key[MAXLINE];
+  snap_rec_t rec;
+  time_t now = time(NULL);
+  int fd, loaded = 0, stale = 0;
+
+  if ((fd = open(snap_path, O_RDONLY)) < 0)
+    return 0;
+  if (fstat(fd, &st) < 0 || st.st_size < 8 ||
+      (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+  {
+    close(fd);
+    return 0;
+  }
+  close(fd);
+  if (memcmp(map, SNAP_MAGIC, 8))
+  {
+    LOGF(LOG_WARN, "snapshot: %s is not a cache snapshot", snap_path);
+    munmap(map, st.st_size);
+    return 0;
+  }
+
+  end = map + st.st_size;
+  for (p = map + 8; p + sizeof(rec) <= end; p += sizeof(rec) + rec.keylen + rec.datalen)
+  {
+    memcpy(&rec, p, sizeof(rec));
+    /* 잘린 파일의 마지막 record는 버린다 */
+    if (rec.keylen >= MAXLINE || (size_t)(end - p) < sizeof(rec) + rec.keylen + rec.datalen)
+      break;
+    if (rec.expires && rec.expires <= now)
+    {
+      stale++;
+      continue;
+    }
+    memcpy(key, p + sizeof(rec), rec.keylen);
+    key[rec.keylen] = '\0';
+    cache_restore(key, p + sizeof(rec) + rec.keylen, rec.datalen, rec.stored, rec.expires);
+    loaded++;
+  }
+  munmap(map, st.st_size);
+  if (stale)
+    LOGF(LOG_INFO, "snapshot: skipped %ld stale objects", NULL, (long)stale);
+  return loaded;
+}
+
+static void *snapshot_thread(void *vargp)
+{
+  int n;
+
+  Pthread_detach(pthread_self());
+  while (1)
+  {
+    sleep(snap_interval);
+    if (!snapshot_enabled())
+      break;
+    n = snapshot_save();
+    LOGF(LOG_DEBUG, "snapshot: saved %ld objects", NULL, (long)n);
+  }
+  return NULL;
+}
+
+void snapshot_start(int load_file)
+{
+  pthread_t tid;
+  long long t;
+  int n;
+
+  if (snap_path == NULL)
+    return;
+  if (load_file)
+  {
+    t = hist_now();
+    n = load();
+    LOGF(LOG_INFO, "snapshot: %s: loaded %ld objects in %ld us", snap_path, (long)n, (long)((hist_now() - t) / 1000));
+  }
+  if (snap_interval > 0)
+    Pthread_create(&tid, NULL, snapshot_thread, NULL);
+}
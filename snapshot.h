@@ -0,0 +1,36 @@
+/*
+ * snapshot.h - 캐시 내용을 파일로 저장했다가 다음 시작 때 다시 채운다
+ *
+ * drain이 끝날 때나 새 process에 listen socket을 넘겨줄 때(drain.h), 그리고 interval을 주면
+ * 그 간격마다 모든 캐시 객체의 key, 응답 전체, 저장/만료 시각을 snapshot 파일에 쓴다. 임시 파일에 쓴 뒤 rename하므로 도중에 죽어도
+ * 이전 snapshot은 남는다. 시작할 때는 파일을 mmap해서 만료되지 않은 객체만 캐시에 넣는다.
+ *
+ * 파일 형식: SNAP_MAGIC(8) 다음에 객체마다
+ *   key 길이(u32), data 길이(u32), stored(i64), expires(i64), key, data
+ * 가 LRU 역순으로 이어진다. 순서대로 넣으면 LRU 순서도 그대로 돌아온다.
+ */
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include "csapp.h"
+
+#define SNAP_MAGIC "PXSNAP01"
+
+/* path가 NULL이면 snapshot을 쓰지 않는다 */
+void snapshot_init(const char *path, int interval_s);
+
+/* cache_init() 뒤에 부른다. load_file이면 파일로 캐시를 채우고, interval이 있으면 주기 저장 쓰레드를
+   띄운다. 다시 띄운 worker(proxy -m)는 이미 차 있는 공유 캐시를 옛 파일로 덮지 않도록 0을 준다 */
+void snapshot_start(int load_file);
+
+/* snapshot 파일이 있고 snapshot_disable() 전이면 1 */
+int snapshot_enabled(void);
+
+/* 이후로는 저장하지 않는다. 파일을 새 process에 넘겨준 뒤 덮어쓰지 않도록. 진행 중인 저장은 기다린다 */
+void snapshot_disable(void);
+
+/* 지금 캐시를 파일에 쓴다. 저장한 객체 수, 실패하거나 snapshot_disable() 뒤면 -1.
+   여러 쓰레드(주기 저장, drain, 넘겨주기)가 불러도 한 번에 하나씩 쓴다 */
+int snapshot_save(void);
+
+#endif /* __SNAPSHOT_H__ */
@@ -0,0 +1,154 @@
+/*
+ * stats.c - 쓰레드별로 나눠 기록하는 proxy 통계 카운터
+ */
+#include "csapp.h"
+#include "stats.h"
+#include "hist.h"
+#include "pool.h"
+#include "log.h"
+#include "config.h"
+#include "shm.h"
+
+#define STATS_SHARDS 64 /* 쓰레드가 이보다 많으면 shard를 나눠 쓴다 (그래도 atomic이라 안전) */
+
+typedef struct
+{
+  long v[STAT_NR];
+} __attribute__((aligned(64))) stats_shard_t;
+
+static const char *stat_names[STAT_NR] = {
+    "requests",
+    "bytes_in",
+    "bytes_out",
+    "cache_hits",
+    "cache_misses",
+    "cache_evictions",
+    "cache_admission_rejects",
+    "cache_range_hits",
+    "negative_hits",
+    "bytes_cached",
+    "cache_slab_bytes",
+    "active_connections",
+    "upstream_connects",
+    "dns_lookups",
+    "errors",
+    "buffered_bytes",
+    "budget_denied",
+    "upstream_timeouts",
+    "queued",
+    "shed",
+    "concurrency_limit",
+    "backend_ejections",
+    "prefetches",
+    "prefetch_used_bytes",
+    "prefetch_wasted_bytes",
+    "config_reloads",
+    "config_errors",
+};
+
+/* 끝난 worker의 몫을 버리는 게이지. 나머지(캐시 게이지 포함)는 다른 process가 이어서 고친다 */
+static const stat_t process_gauges[] = {STAT_ACTIVE_CONNS, STAT_BUFFERED_BYTES, STAT_QUEUED, STAT_ADMIT_LIMIT};
+
+static stats_shard_t local_shards[STATS_SHARDS];
+static stats_shard_t *shards = local_shards; /* process마다 STATS_SHARDS개씩, nblocks묶음 */
+static int nblocks = 1;
+static stats_shard_t *my_block = local_shards;
+static int next_shard;
+static __thread stats_shard_t *my_shard;
+
+void stats_share(int procs)
+{
+  nblocks = procs + 1;
+  shards = shm_alloc(nblocks * STATS_SHARDS * sizeof(stats_shard_t));
+  my_block = &shards[procs * STATS_SHARDS];
+}
+
+void stats_attach(int proc)
+{
+  my_block = &shards[proc * STATS_SHARDS];
+  my_shard = NULL;
+}
+
+void stats_forget(int proc)
+{
+  int i, j;
+
+  for (i = 0; i < STATS_SHARDS; i++)
+    for (j = 0; j < (int)(sizeof(process_gauges) / sizeof(process_gauges[0])); j++)
+      __atomic_store_n(&shards[proc * STATS_SHARDS + i].v[process_gauges[j]], 0, __ATOMIC_RELAXED);
+}
+
+void stats_clear(stat_t stat)
+{
+  int i;
+
+  for (i = 0; i < nblocks * STATS_SHARDS; i++)
+    __atomic_store_n(&shards[i].v[stat], 0, __ATOMIC_RELAXED);
+}
+
+void stats_add(stat_t stat, long delta)
+{
+  if (my_shard == NULL)
+    my_shard = &my_block[__atomic_fetch_add(&next_shard, 1, __ATOMIC_RELAXED) % STATS_SHARDS];
+  __atomic_fetch_add(&my_shard->v[stat], delta, __ATOMIC_RELAXED);
+}
+
+void stats_snapshot(long *out)
+{
+  int i, j;
+
+  memset(out, 0, STAT_NR * sizeof(long));
+  for (i = 0; i < nblocks * STATS_SHARDS; i++)
+    for (j = 0; j < STAT_NR; j++)
+      out[j] += __atomic_load_n(&shards[i].v[j], __ATOMIC_RELAXED);
+}
+
+void stats_serve(int connfd, char *query)
+{
+  char hdr[MAXLINE], *body;
+  size_t len;
+  long v[STAT_NR];
+  int i, json = query != NULL && strstr(query, "json") != NULL;
+  FILE *out;
+
+  /* backend 수나 설정 파일 경로에 따라 길이가 정해지지 않으므로 필요한 만큼 늘어나는 heap 버퍼에 쓴다 */
+  if ((out = open_memstream(&body, &len)) == NULL)
+  {
+    LOGF(LOG_WARN, "stats: open_memstream: %s", strerror(errno));
+    return;
+  }
+  stats_snapshot(v);
+  if (json)
+  {
+    fprintf(out, "{");
+    for (i = 0; i < STAT_NR; i++)
+      fprintf(out, "%s\"%s\": %ld", i ? ", " : "", stat_names[i], v[i]);
+    fprintf(out, ", \"log_dropped\": %ld", log_dropped());
+    fprintf(out, ", \"latency_ns\": {");
+    hist_report(out, 1);
+    fprintf(out, "}, \"backends\": {");
+    pool_report(out, 1);
+    fprintf(out, "}, \"config\": {");
+    config_report(out, 1);
+    fprintf(out, "}}\n");
+  }
+  else
+  {
+    for (i = 0; i < STAT_NR; i++)
+      fprintf(out, "%s %ld\n", stat_names[i], v[i]);
+    fprintf(out, "log_dropped %ld\n", log_dropped());
+    hist_report(out, 0);
+    pool_report(out, 0);
+    config_report(out, 0);
+  }
+  fclose(out);
+
+  sprintf(hdr, "HTTP/1.0 200 OK\r\n"
+               "Content-type: %s\r\n"
+               "Content-length: %zu\r\n"
+               "Connection: close\r\n\r\n",
+          json ? "application/json" : "text/plain", len);
+  Rio_writen(connfd, hdr, strlen(hdr));
+  Rio_writen(connfd, body, len);
+  free(body);
+}
@@ -0,0 +1,73 @@
+/*
+ * stats.h - proxy 통계 카운터
+ *
+ * 카운터는 쓰레드별 shard(캐시 라인 하나씩)에 나눠 기록하고, 읽을 때만 모두 더한다.
+ * 기록 쪽은 자기 shard에 relaxed atomic add 한 번이라 lock이나 캐시 라인 경합이 없다.
+ * 게이지(활성 연결 수, 캐시된 바이트 수)도 +/- 델타를 기록해 합으로 구한다.
+ * worker process를 여러 개 띄우면(proxy -m) shard를 공유 메모리(shm.h)에 process마다 따로 두고,
+ * 읽을 때 모든 process의 것을 더한다. 단계별 지연 시간(hist.h)은 응답한 worker의 것만 보인다.
+ */
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include "csapp.h"
+
+/* 이 host/path로 오는 요청은 end server로 보내지 않고 proxy가 직접 통계를 응답한다 */
+#define STATS_HOST "proxy.local"
+#define STATS_PATH "/__stats"
+
+typedef enum
+{
+  STAT_REQUESTS,          /* 처리한 요청 수 */
+  STAT_BYTES_IN,          /* end server로부터 받은 바이트 */
+  STAT_BYTES_OUT,         /* client에게 보낸 바이트 (캐시 hit 포함) */
+  STAT_CACHE_HITS,
+  STAT_CACHE_MISSES,
+  STAT_CACHE_EVICTIONS,
+  STAT_CACHE_REJECTS,     /* tinylfu admission이 거절한 객체 */
+  STAT_RANGE_HITS,        /* 캐시된 객체에서 부분(206/416) 응답한 Range 요청 */
+  STAT_NEG_HITS,          /* 캐시된 오류 응답이나 기억한 DNS/connect 실패로 바로 답한 요청 */
+  STAT_BYTES_CACHED,      /* 게이지 */
+  STAT_CACHE_SLAB_BYTES,  /* 게이지: 캐시 객체에 배정된 slab page (slab.h). 캐시의 실제 메모리 */
+  STAT_ACTIVE_CONNS,      /* 게이지 */
+  STAT_UPSTREAM_CONNECTS, /* 성공한 end server 연결 */
+  STAT_DNS_LOOKUPS,       /* getaddrinfo() 호출 수 */
+  STAT_ERRORS,
+  STAT_BUFFERED_BYTES,    /* 게이지: budget.h로 확보한 중계/캐시 버퍼 */
+  STAT_BUDGET_DENIED,     /* 전역 메모리 예산이 모자라 버퍼를 못 잡은 횟수 */
+  STAT_UPSTREAM_TIMEOUTS, /* end server connect/응답 deadline을 넘긴 횟수 */
+  STAT_QUEUED,            /* 게이지: worker를 기다리는 연결 */
+  STAT_SHED,              /* 대기열이 가득 차 503으로 돌려보낸 연결 */
+  STAT_ADMIT_LIMIT,       /* 게이지: 동시 처리 한도 (admit.h) */
+  STAT_BACKEND_EJECTIONS, /* health check 실패로 backend를 pool에서 뺀 횟수 */
+  STAT_PREFETCHES,        /* 미리 받아 캐시에 넣은 객체 수 */
+  STAT_PREFETCH_USED,     /* 미리 받은 뒤 hit된 바이트 */
+  STAT_PREFETCH_WASTED,   /* 미리 받았지만 쓰이지 않고 버려진 바이트 */
+  STAT_CONFIG_RELOADS,    /* SIGHUP으로 설정 파일을 다시 읽어 적용한 횟수 */
+  STAT_CONFIG_ERRORS,     /* 설정 파일이 틀려 이전 설정을 유지한 횟수 */
+  STAT_NR
+} stat_t;
+
+/* procs개 worker의 shard를 공유 메모리에 잡는다. fork하기 전에 */
+void stats_share(int procs);
+
+/* fork한 worker가 자기 번호의 shard를 쓰게 한다 */
+void stats_attach(int proc);
+
+/* 끝난 worker의 연결, 버퍼, 대기열 게이지를 지운다. 카운터는 그대로 남는다 */
+void stats_forget(int proc);
+
+/* 모든 process의 stat을 0으로. 그 stat을 바꾸는 쪽이 모두 멈춰 있을 때만 (캐시 게이지는 캐시 lock 안에서) */
+void stats_clear(stat_t stat);
+
+void stats_add(stat_t stat, long delta);
+#define stats_inc(stat) stats_add((stat), 1)
+
+/* 모든 shard를 합산해 out[STAT_NR]에 채운다 */
+void stats_snapshot(long *out);
+
+/* connfd로 통계와 단계별 지연 시간 백분위수(hist.h)를 응답(HTTP/1.0)한다.
+   query에 "json"이 있으면 JSON, 아니면 plain text */
+void stats_serve(int connfd, char *query);
+
+#endif /* __STATS_H__ */
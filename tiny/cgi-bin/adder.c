@@ -26,10 +26,10 @@ int main(void)
   /* sprintf = formatted string output to array */                     // 지정된 형식의 문자열을 생성하여 배열에 저장 //printf와의 차이??? -> 출력 대상이 표준 출력이 아니라 문자열 배열이거나 버퍼이다.
   sprintf(content, "QUERY_STRING=%s", buf);                            // 쿼리 문자열을 응답 내용(content)에 추가
   sprintf(content, "Welcome to add.com: ");                            // 환영 메시지를 응답 내용(content)에 추가
-  sprintf(content, "%sTHE Internet addition portal.\r\n<p>", content); // 덧셈 포털 정보를 응답 내용(content)에 추가
-  sprintf(content, "%sThe answer is: %d + %d = %d\r\n<p>",             // 덧셈 결과를 응답 내용(content)에 추가
-          content, n1, n2, n1 + n2);
-  sprintf(content, "%sThanks for visiting!\r\n", content); // 방문객에 대한 감사 메시지를 응답 내용(content)에 추가
+  sprintf(content + strlen(content), "THE Internet addition portal.\r\n<p>"); // 덧셈 포털 정보를 응답 내용(content)에 추가
+  sprintf(content + strlen(content), "The answer is: %d + %d = %d\r\n<p>",             // 덧셈 결과를 응답 내용(content)에 추가
+          n1, n2, n1 + n2);
+  sprintf(content + strlen(content), "Thanks for visiting!\r\n"); // 방문객에 대한 감사 메시지를 응답 내용(content)에 추가
 
   /* Generate the HTTP response */
   /* header */
@@ -7,6 +7,8 @@
  *   - Fixed sprintf() aliasing issue in serve_static(), and clienterror().
  */
 #include "csapp.h"
+#include "log.h"
+#include "arena.h"
 
 /*
  * doit - 클라이언트 요청을 처리합니다.
@@ -17,11 +19,12 @@
  *
  * 매개변수:
  *   fd: 클라이언트 연결의 파일 디스크립터
+ *   arena: 요청 줄, 헤더, 파싱한 문자열을 담을 arena (비우는 것은 호출한 쪽)
  *
  * 반환값:
  *   없음
  */
-void doit(int fd);
+void doit(int fd, arena_t *arena);
 
 /*
  * read_requesthdrs - HTTP 요청 헤더를 읽고 처리합니다.
@@ -30,12 +33,13 @@ void doit(int fd);
  * 이 함수는 클라이언트 연결로부터 요청 헤더를 읽어들이고 필요한 처리를 수행합니다.
  *
  * 매개변수:
+ *   arena: 각 줄을 읽어 둘 arena (읽은 줄은 바로 돌려준다)
  *   rp: 클라이언트 연결에서 읽기 위한 rio_t 구조체의 포인터
  *
  * 반환값:
- *   없음
+ *   Range 헤더의 값 (arena 안). 없으면 NULL
  */
-void read_requesthdrs(rio_t *rp);
+char *read_requesthdrs(arena_t *arena, rio_t *rp);
 
 /*
  * parse_uri - URI를 파일 이름과 CGI 인수로 파싱합니다.
@@ -64,11 +68,25 @@ int parse_uri(char *uri, char *filename, char *cgiargs);
  *   filename: 제공할 정적 콘텐츠 파일의 이름
  *   filesize: 제공할 파일의 크기
  *   method: HTTP 요청 메서드 (GET, HEAD) // 11.11
+ *   range: Range 헤더의 값. 구간 하나("bytes=a-b", "a-", "-n")면 그 부분만 206으로 보낸다
  *
  * 반환값:
  *   없음
  */
-void serve_static(int fd, char *filename, int filesize, char *method, char *version);
+void serve_static(int fd, char *filename, int filesize, char *method, char *version, char *range);
+
+/*
+ * parse_range - Range 헤더 값에서 구간 하나를 읽습니다.
+ *
+ * 매개변수:
+ *   range: Range 헤더의 값
+ *   filesize: 파일 크기
+ *   first, last: 보낼 구간 (양 끝 포함)
+ *
+ * 반환값:
+ *   구간을 보낼 수 있으면 1, 파일 밖이면 -1 (416), 여러 구간이거나 문법이 틀리면 0 (전체를 보냄)
+ */
+int parse_range(char *range, int filesize, long *first, long *last);
 
 /*
  * get_filetype - 확장자에 기반하여 파일의 콘텐츠 유형을 결정합니다.
@@ -137,25 +155,43 @@ int main(int argc, char **argv)
   socklen_t clientlen;
   struct sockaddr_storage clientaddr;
 
+  int opt, level = LOG_INFO;
+  arena_t arena; // 요청마다 비우고 다시 쓰는 arena
+
   /* Check command line args */
-  if (argc != 2)
+  /* -l : 로그 레벨 (error|warn|info|debug), 실행 중에는 SIGUSR1/SIGUSR2로 조절 */
+  while ((opt = getopt(argc, argv, "l:")) != -1)
   {
-    fprintf(stderr, "usage: %s <port>\n", argv[0]);
+    if (opt != 'l' || (level = log_parse_level(optarg)) < 0)
+    {
+      fprintf(stderr, "usage: %s [-l error|warn|info|debug] <port>\n", argv[0]);
+      exit(1);
+    }
+  }
+  if (argc - optind != 1)
+  {
+    fprintf(stderr, "usage: %s [-l error|warn|info|debug] <port>\n", argv[0]);
     exit(1);
   }
+  log_init(level); // printf 대신 비동기 로그 사용
 
   /* 11.8 */                                        // SIGCHLD 시그널을 처리하기 위한 시그널 핸들러를 설정합니다.
   if (Signal(SIGCHLD, sigchild_handler) == SIG_ERR) // 이 핸들러는 자식 프로세스가 종료될 때 발생하는 시그널을 처리합니다.
     unix_error("signal child handler error");       // 만약 핸들러 설정에 실패하면 오류 메시지를 출력합니다.
 
-  listenfd = Open_listenfd(argv[1]);
+  arena_init(&arena, ARENA_BLOCK);
+  listenfd = Open_listenfd(argv[optind]);
   while (1) // 무한 루프 시작
   {
     clientlen = sizeof(clientaddr);
     connfd = Accept(listenfd, (SA *)&clientaddr, &clientlen);                       // 클라이언트로부터 연결을 수락하고 연결 소켓 생성 // 무한 루프 내에서 반복적으로 연결 요청을 접수
-    Getnameinfo((SA *)&clientaddr, clientlen, hostname, MAXLINE, port, MAXLINE, 0); // 클라이언트의 호스트명과 포트 번호 가져오기
-    printf("Accepted connection from (%s, %s)\n", hostname, port);                  // 클라이언트 정보 출력
-    doit(connfd);                                                                   // 요청 처리 함수 호출 // 트랜잭션을 수행
+    if (LOG_INFO <= log_level)                                                        // 로그를 남길 때만 이름 변환
+    {
+      Getnameinfo((SA *)&clientaddr, clientlen, hostname, MAXLINE, port, MAXLINE, 0); // 클라이언트의 호스트명과 포트 번호 가져오기
+      LOGF(LOG_INFO, "Accepted connection from (%s, %ld)", hostname, atol(port));    // 클라이언트 정보 출력
+    }
+    doit(connfd, &arena);                                                           // 요청 처리 함수 호출 // 트랜잭션을 수행
+    arena_reset(&arena);                                                            // 요청에 쓴 메모리를 한 번에 비우기
     Close(connfd);                                                                  // 연결 소켓 닫기
   }
 }
@@ -177,20 +213,27 @@ void sigchild_handler(int sig)
   errno = old_errno;
 }
 
-void doit(int fd) // 한 개의 HTTP 트랜잭션을 처리한다
+void doit(int fd, arena_t *arena) // 한 개의 HTTP 트랜잭션을 처리한다
 {
-  int is_static;                                                      // 정적 컨텐츠 여부를 나타내는 변수
-  struct stat sbuf;                                                   // 파일 정보를 저장할 구조체
-  char buf[MAXLINE], method[MAXLINE], uri[MAXLINE], version[MAXLINE]; // 버퍼 및 요청 정보를 저장할 변수들
-  char filename[MAXLINE], cgiargs[MAXLINE];                           // 파일 경로 및 CGI 인자를 저장할 변수들
-  rio_t rio;                                                          // Rio 버퍼 구조체
-
-  /* Read request line and headers */       /* 요청 라인 및 헤더 읽기 */
-  Rio_readinitb(&rio, fd);                  // Rio 버퍼 초기화
-  if (!(Rio_readlineb(&rio, buf, MAXLINE))) // 요청을 받아오지 못했다면 바로 return하여 doit을 종료
-    return;                                 // 무한루프 문제 해결...?
-  printf("Request headers:\n");
-  printf("%s", buf);                             // 읽은 요청 헤더 출력
+  int is_static;                            // 정적 컨텐츠 여부를 나타내는 변수
+  struct stat sbuf;                         // 파일 정보를 저장할 구조체
+  char *buf, *method, *uri, *version;       // 버퍼 및 요청 정보를 저장할 변수들 (arena에서 실제 길이만큼)
+  char *filename, *cgiargs;                 // 파일 경로 및 CGI 인자를 저장할 변수들
+  char *range;                              // Range 헤더 값
+  size_t len;                               // 요청 라인 길이
+  rio_t *rio = arena_alloc(arena, sizeof(rio_t)); // Rio 버퍼 구조체
+
+  /* Read request line and headers */           /* 요청 라인 및 헤더 읽기 */
+  Rio_readinitb(rio, fd);                       // Rio 버퍼 초기화
+  if ((buf = arena_readline(arena, rio)) == NULL) // 요청을 받아오지 못했다면 바로 return하여 doit을 종료
+    return;                                     // 무한루프 문제 해결...?
+  LOGF(LOG_INFO, "Request headers:", NULL);
+  LOGF(LOG_INFO, "%s", buf); // 읽은 요청 헤더 출력
+  len = strlen(buf) + 1;     // 요청 라인의 어느 부분도 이보다 길 수 없다
+  method = arena_alloc(arena, len);
+  uri = arena_alloc(arena, len);
+  version = arena_alloc(arena, len);
+  method[0] = uri[0] = version[0] = '\0';
   sscanf(buf, "%s %s %s", method, uri, version); // 요청 라인 파싱
 
   /* 11.11 */
@@ -199,9 +242,11 @@ void doit(int fd) // 한 개의 HTTP 트랜잭션을 처리한다
     clienterror(fd, method, "501", "Not implemented", "Tiny does not implement this method", version); /* 11.6 C */
     return;
   }
-  read_requesthdrs(&rio); // 요청 헤더 읽기
+  range = read_requesthdrs(arena, rio); // 요청 헤더 읽기
 
   /* Parse URI from GET request */               /* GET 요청으로부터 URI 파싱 */
+  filename = arena_alloc(arena, len + strlen("./home.html")); // "." + uri + "home.html"
+  cgiargs = arena_alloc(arena, len);
   is_static = parse_uri(uri, filename, cgiargs); // URI 파싱
   if (stat(filename, &sbuf) < 0)                 // 파일 정보 읽기
   {
@@ -216,7 +261,7 @@ void doit(int fd) // 한 개의 HTTP 트랜잭션을 처리한다
       clienterror(fd, filename, "403", "Forbidden", "Tiny couldn't read the file", version); /* 11.6 C */
       return;
     }
-    serve_static(fd, filename, sbuf.st_size, method, version); // 정적 컨텐츠 서비스 /* 11.11 */ /* 11.6 C */
+    serve_static(fd, filename, sbuf.st_size, method, version, range); // 정적 컨텐츠 서비스 /* 11.11 */ /* 11.6 C */
   }
   else /* Serve dynamic content */ /* 동적 컨텐츠 제공 */
   {
@@ -236,13 +281,12 @@ void clienterror(int fd, char *cause, char *errnum, char *shortmsg, char *longms
 
   /* Build the HTTP response body */ /* HTTP 응답 본문 작성 */
   sprintf(body, "<html><title>Tiny Error</title>");
-  sprintf(body, "%s<body bgcolor="
-                "ffffff"
-                ">\r\n",
-          body);
-  sprintf(body, "%s%s: %s\r\n", body, errnum, shortmsg);
-  sprintf(body, "%s<p>%s: %s\r\n", body, longmsg, cause);
-  sprintf(body, "%s<hr><em>The Tiny Web server</em>\r\n", body);
+  sprintf(body + strlen(body), "<body bgcolor="
+                               "ffffff"
+                               ">\r\n");
+  sprintf(body + strlen(body), "%s: %s\r\n", errnum, shortmsg);
+  sprintf(body + strlen(body), "<p>%s: %s\r\n", longmsg, cause);
+  sprintf(body + strlen(body), "<hr><em>The Tiny Web server</em>\r\n");
 
   /* Print the HTTP response */                            /* HTTP 응답 전송 */
   sprintf(buf, "%s %s %s\r\n", version, errnum, shortmsg); /* 11.6 C */
@@ -254,18 +298,24 @@ void clienterror(int fd, char *cause, char *errnum, char *shortmsg, char *longms
   Rio_writen(fd, body, strlen(body));
 }
 
-void read_requesthdrs(rio_t *rp)
+char *read_requesthdrs(arena_t *arena, rio_t *rp)
 {
-  char buf[MAXLINE];
+  char *buf, *range = NULL;
 
-  // 빈 줄이 나올 때까지 요청 헤더의 각 줄을 읽음
-  Rio_readlineb(rp, buf, MAXLINE);
-  while (strcmp(buf, "\r\n"))
+  // 빈 줄이 나올 때까지 요청 헤더의 각 줄을 읽음 (EOF여도 멈춤)
+  while ((buf = arena_readline(arena, rp)) != NULL && strcmp(buf, "\r\n"))
   {
-    Rio_readlineb(rp, buf, MAXLINE);
-    printf("%s", buf); // 각 헤더 줄을 출력
+    LOGF(LOG_INFO, "%s", buf); // 각 헤더 줄을 출력
+    if (range == NULL && !strncasecmp(buf, "Range:", 6)) // Range 값만 남겨둠
+    {
+      for (range = buf + 6; *range == ' '; range++)
+        ;
+      range[strcspn(range, "\r\n")] = '\0';
+      continue;
+    }
+    arena_trim(arena, buf, 0); // 나머지 헤더는 남겨둘 필요가 없으므로 자리를 바로 돌려줌
   }
-  return;
+  return range;
 }
 
 int parse_uri(char *uri, char *filename, char *cgiargs)
@@ -304,21 +354,83 @@ int parse_uri(char *uri, char *filename, char *cgiargs)
   }
 }
 
-void serve_static(int fd, char *filename, int filesize, char *method, char *version) // 정적 컨텐츠 출력 /* 11.11 *//* 11.6 C */
+int parse_range(char *range, int filesize, long *first, long *last)
 {
-  int srcfd;
-  char *srcp, filetype[MAXLINE], buf[MAXBUF];
+  char *end;
+
+  if (strncasecmp(range, "bytes=", 6) || strchr(range, ',')) // 여러 구간은 지원하지 않음
+    return 0;
+  range += 6;
+  if (*range == '-') // 마지막 n 바이트
+  {
+    *last = filesize - 1;
+    *first = filesize - strtol(range + 1, &end, 10);
+    if (*first < 0)
+      *first = 0;
+    return end == range + 1 || *end ? 0 : *first <= *last ? 1 : -1;
+  }
+  *first = strtol(range, &end, 10);
+  if (end == range || *end++ != '-')
+    return 0;
+  *last = *end ? strtol(end, &end, 10) : filesize - 1;
+  if (*end || *last < *first)
+    return 0;
+  if (*last >= filesize)
+    *last = filesize - 1;
+  return *first < filesize ? 1 : -1;
+}
+
+void serve_static(int fd, char *filename, int filesize, char *method, char *version, char *range) // 정적 컨텐츠 출력 /* 11.11 *//* 11.6 C */
+{
+  int srcfd, partial = 0;
+  long first = 0, last = filesize - 1, len;
+  char *srcp = NULL, filetype[32], buf[MAXBUF]; /* filetype은 get_filetype의 MIME 이름 하나 */
+
+  /* 구간 하나짜리 Range면 그 부분만 보낸다 (동영상 탐색) */
+  if (range != NULL && (partial = parse_range(range, filesize, &first, &last)) < 0)
+  {
+    clienterror(fd, filename, "416", "Range Not Satisfiable", "Tiny couldn't satisfy the requested range", version);
+    return;
+  }
+  if (partial == 0)
+  {
+    first = 0;
+    last = filesize - 1;
+  }
+  len = last - first + 1;
+
+  /* 본문은 header보다 먼저 읽어 둔다. 구간을 못 읽으면 206 대신 오류로 답한다 */
+  if (strcasecmp(method, "HEAD"))
+  {
+    srcfd = Open(filename, O_RDONLY, 0); // O_RDONLY 파일을 읽기 전용으로 열려고 할 때 사용하는 플래그
+    // srcp = Mmap(0, filesize, PROT_READ, MAP_PRIVATE, rcfsd, 0); // PROT_READ 페이지에 대한 읽기 권한을 허용하는 플래그 // MAP_PRIVATE 매핑된 메모리 영역이 다른 프로세스와 공유되지 않음을 지정하는 플래그
+    srcp = (char *)Malloc(len); /* 11.9 */ // 요청한 구간만큼만
+    if (lseek(srcfd, first, SEEK_SET) != first || rio_readn(srcfd, srcp, len) != len)
+    {
+      Close(srcfd);
+      free(srcp);
+      clienterror(fd, filename, "500", "Internal Server Error", "Tiny couldn't read the file", version);
+      return;
+    }
+    Close(srcfd);
+  }
 
   /* Send response headers to client */
-  get_filetype(filename, filetype);       /* 11.6 C */
-  sprintf(buf, "%s 200 OK\r\n", version); /* 11.6 C */
-  sprintf(buf, "%sServer: Tiny Web Server\r\n", buf);
-  sprintf(buf, "%sConnection: close\r\n", buf);
-  sprintf(buf, "%sContent-length: %d\r\n", buf, filesize);
-  sprintf(buf, "%sContent-type: %s\r\n\r\n", buf, filetype);
+  get_filetype(filename, filetype); /* 11.6 C */
+  if (partial)
+    sprintf(buf, "%s 206 Partial Content\r\n", version);
+  else
+    sprintf(buf, "%s 200 OK\r\n", version); /* 11.6 C */
+  sprintf(buf + strlen(buf), "Server: Tiny Web Server\r\n");
+  sprintf(buf + strlen(buf), "Connection: close\r\n");
+  sprintf(buf + strlen(buf), "Accept-Ranges: bytes\r\n");
+  if (partial)
+    sprintf(buf + strlen(buf), "Content-Range: bytes %ld-%ld/%d\r\n", first, last, filesize);
+  sprintf(buf + strlen(buf), "Content-length: %ld\r\n", len);
+  sprintf(buf + strlen(buf), "Content-type: %s\r\n\r\n", filetype);
   Rio_writen(fd, buf, strlen(buf));
-  printf("Response headers:\n");
-  printf("%s", buf);
+  LOGF(LOG_INFO, "Response headers:", NULL);
+  LOGF(LOG_INFO, "%s", buf);
 
   /* 11.11 */
   /* 만약 HTTP 요청 메서드가 "HEAD"일 경우, */ // HEAD 메서드일 때, 서버는 실제 리소스 본문을 제외한 응답 헤더만을 전송한다.(메타데이터만을 요청한다.)
@@ -326,12 +438,7 @@ void serve_static(int fd, char *filename, int filesize, char *method, char *vers
     return;
 
   /* Send response body to client */
-  srcfd = Open(filename, O_RDONLY, 0); // O_RDONLY 파일을 읽기 전용으로 열려고 할 때 사용하는 플래그
-  // srcp = Mmap(0, filesize, PROT_READ, MAP_PRIVATE, rcfsd, 0); // PROT_READ 페이지에 대한 읽기 권한을 허용하는 플래그 // MAP_PRIVATE 매핑된 메모리 영역이 다른 프로세스와 공유되지 않음을 지정하는 플래그
-  srcp = (char *)Malloc(filesize);  /* 11.9 */
-  Rio_readn(srcfd, srcp, filesize); /* 11.9 */
-  Close(srcfd);
-  Rio_writen(fd, srcp, filesize);
+  Rio_writen(fd, srcp, len);
   // Munmap(srcp, filesize);
   free(srcp); /* 11.9 */
 }
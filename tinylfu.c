@@ -0,0 +1,88 @@
+/*
+ * tinylfu.c - count-min sketch + doorkeeper bloom filter + aging
+ */
+#include "tinylfu.h"
+#include "shm.h"
+#include <string.h>
+
+typedef struct
+{
+  unsigned char sketch[SKETCH_DEPTH][SKETCH_WIDTH];
+  uint64_t doorkeeper[DOORKEEPER_BITS / 64];
+  int samples;
+} tinylfu_t;
+
+static tinylfu_t *t; /* 공유 메모리(shm.h) */
+
+void tinylfu_init(void)
+{
+  t = shm_alloc(sizeof(tinylfu_t));
+}
+
+void tinylfu_reset(void)
+{
+  memset(t, 0, sizeof(tinylfu_t));
+}
+
+/* 64비트 해시 하나로 위치 여러 개를 만든다 (double hashing) */
+static unsigned slot(uint64_t hash, int i, unsigned mask)
+{
+  uint32_t lo = (uint32_t)hash, hi = (uint32_t)(hash >> 32) | 1;
+
+  return (lo + i * hi) & mask;
+}
+
+static int door_test_and_set(uint64_t hash)
+{
+  unsigned a = slot(hash, 7, DOORKEEPER_BITS - 1), b = slot(hash, 11, DOORKEEPER_BITS - 1);
+  int present = (t->doorkeeper[a / 64] >> (a % 64) & 1) && (t->doorkeeper[b / 64] >> (b % 64) & 1);
+
+  t->doorkeeper[a / 64] |= 1ULL << (a % 64);
+  t->doorkeeper[b / 64] |= 1ULL << (b % 64);
+  return present;
+}
+
+static int door_test(uint64_t hash)
+{
+  unsigned a = slot(hash, 7, DOORKEEPER_BITS - 1), b = slot(hash, 11, DOORKEEPER_BITS - 1);
+
+  return (t->doorkeeper[a / 64] >> (a % 64) & 1) && (t->doorkeeper[b / 64] >> (b % 64) & 1);
+}
+
+static void age(void)
+{
+  int i, j;
+
+  for (i = 0; i < SKETCH_DEPTH; i++)
+    for (j = 0; j < SKETCH_WIDTH; j++)
+      t->sketch[i][j] >>= 1;
+  memset(t->doorkeeper, 0, sizeof(t->doorkeeper));
+  t->samples = 0;
+}
+
+void tinylfu_record(uint64_t hash)
+{
+  unsigned char *c;
+  int i;
+
+  if (++t->samples >= SKETCH_SAMPLE)
+    age();
+  if (!door_test_and_set(hash))
+    return;
+  for (i = 0; i < SKETCH_DEPTH; i++)
+  {
+    c = &t->sketch[i][slot(hash, i, SKETCH_WIDTH - 1)];
+    if (*c < SKETCH_MAX)
+      (*c)++;
+  }
+}
+
+int tinylfu_estimate(uint64_t hash)
+{
+  int i, v, min = SKETCH_MAX;
+
+  for (i = 0; i < SKETCH_DEPTH; i++)
+    if ((v = t->sketch[i][slot(hash, i, SKETCH_WIDTH - 1)]) < min)
+      min = v;
+  return min + door_test(hash);
+}
@@ -0,0 +1,40 @@
+/*
+ * tinylfu.h - 캐시 admission을 위한 접근 빈도 sketch (TinyLFU)
+ *
+ * 캐시가 가득 찼을 때 새 객체가 자기 자리를 위해 밀어낼 객체들(같은 class의 LRU victim, 또는 비울
+ * page 구간에 걸친 객체 모두. cache.c의 admit)의 추정 빈도 합보다 자주 쓰이는지를 판단한다.
+ * 한 번만 쓰이고 마는 객체(one-hit wonder)가 자주 쓰이는 객체를 밀어내지 못하게 하려는 것.
+ *
+ *   - count-min sketch: SKETCH_DEPTH개의 행마다 key 해시로 칸 하나씩 올리고, 추정치는 그 최솟값.
+ *     칸은 15에서 멈춘다.
+ *   - doorkeeper: 처음 보는 key는 bloom filter에만 적고 sketch는 올리지 않는다.
+ *     한 번만 오는 key가 sketch를 더럽히지 않는다.
+ *   - aging: 기록이 SKETCH_SAMPLE번 쌓이면 모든 칸을 반으로 줄이고 doorkeeper를 비운다.
+ *     오래전 인기가 지금의 인기를 이기지 않도록.
+ *
+ * sketch는 공유 메모리(shm.h)에 있어 worker process들이 함께 센다. lock은 없다. 캐시 mutex 안에서만 부른다.
+ */
+#ifndef __TINYLFU_H__
+#define __TINYLFU_H__
+
+#include <stdint.h>
+
+#define SKETCH_DEPTH 4
+#define SKETCH_WIDTH 4096          /* 행 하나의 칸 수 (2의 거듭제곱) */
+#define SKETCH_MAX 15
+#define SKETCH_SAMPLE 8192         /* aging 간격 (기록 수) */
+#define DOORKEEPER_BITS (1 << 15)  /* 2의 거듭제곱 */
+
+/* sketch를 잡는다. worker를 fork하기 전에 */
+void tinylfu_init(void);
+
+/* 모든 기록을 지운다 */
+void tinylfu_reset(void);
+
+/* 접근 한 번을 기록한다 */
+void tinylfu_record(uint64_t hash);
+
+/* 최근 접근 빈도 추정치 */
+int tinylfu_estimate(uint64_t hash);
+
+#endif /* __TINYLFU_H__ */